@@ -34,6 +34,7 @@ class MainWindow : public QMainWindow
          m_iHeight(768),
 		m_iNumWorkers(std::thread::hardware_concurrency() / 2),
 		m_iMaxSamplesPerPixel(16),
+		m_iPassSamplesPerPixel(1),
 		m_iMaxTraceDepth(32),
 		m_uRandSeed(1)
 	{
@@ -51,6 +52,7 @@ class MainWindow : public QMainWindow
         QImage image(m_iWidth, m_iHeight, QImage::Format_RGB888);
 
         if (m_pSource != nullptr) {
+            m_pSource->resolve();      // (progressive passes accumulated so far)
             std::memcpy(image.bits(),
                         m_pSource->image().data(),
                         m_pSource->image().size());
@@ -75,12 +77,15 @@ class MainWindow : public QMainWindow
                                                 m_iNumWorkers,
                                                 m_iMaxSamplesPerPixel,
                                                 m_iMaxTraceDepth,
-                                                m_uRandSeed);
+                                                m_uRandSeed,
+                                                0, INTEGRATOR::PATH, 0, 0.0f,
+                                                m_iPassSamplesPerPixel);
         }
         else if (tp - m_tpLastFrame > std::chrono::milliseconds(200)) {
 				m_pSource->updateFrameProgress();
-				printf("active jobs=%d, progress=%.2f, time_to_finish=%.2fs, total_time=%.2fs, rays_ps=%.2f\n",
-					   (int)m_pSource->activeJobs(), m_pSource->progress(), m_pSource->timeToFinish(), m_pSource->timeTotal(), m_pSource->raysPerSecond());
+				printf("active jobs=%d, progress=%.2f, passes=%d/%d, time_to_finish=%.2fs, total_time=%.2fs, rays_ps=%.2f\n",
+					   (int)m_pSource->activeJobs(), m_pSource->progress(), m_pSource->completedPasses(), m_pSource->passes(),
+					   m_pSource->timeToFinish(), m_pSource->timeTotal(), m_pSource->raysPerSecond());
 				this->update(this->rect());
 				m_tpLastFrame = tp;
 		}
@@ -111,6 +116,7 @@ class MainWindow : public QMainWindow
     int                                 m_iHeight;
     int                                 m_iNumWorkers;
     int                                 m_iMaxSamplesPerPixel;
+    int                                 m_iPassSamplesPerPixel;     // (progressive passes, for quick previews)
     int                                 m_iMaxTraceDepth;
     uint32_t                            m_uRandSeed;
 };
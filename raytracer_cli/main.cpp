@@ -11,6 +11,8 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <vector>
+#include <cstdlib>
 
 
 using namespace CORE;
@@ -31,17 +33,63 @@ using namespace SYSTEMS;
 const int width = 1600;
 const int height = 1200;
 const int numWorkers = std::thread::hardware_concurrency() + 2;
-const int maxSamplesPerPixel = 16;
+int maxSamplesPerPixel = 16;         // (--spp=N)
+int minSamplesPerPixel = 8;          // (--min-spp=N)
+float adaptiveThreshold = 0.0f;      // (--adaptive=T)
+int passSamplesPerPixel = 0;         // (--pass-spp=N)
+float timeBudgetS = 0.0f;            // (--time=S)
+float noiseTarget = 0.0f;            // (--noise=N)
+int tileSize = 0;                    // (--tile=N)
+TILE_ORDER tileOrder = TILE_ORDER::HILBERT;
 const int maxTraceDepth = 64;
 const uint32_t randSeed = 1;
 
 using clock_type = std::chrono::high_resolution_clock;
 
 
-int runFrame(const std::shared_ptr<Loader> &_pLoader, const std::string &_strOutputPath)
+// print scene, acceleration structure and mesh stats (for scenes built from SimpleScene)
+void printSceneStats(const Scene *_pScene, float _fLoadTimeS)
+{
+    auto pSimpleScene = dynamic_cast<const SimpleScene*>(_pScene);
+    if (pSimpleScene == nullptr) {
+        return;
+    }
+    
+    // instanced meshes are reported once
+    std::vector<const Mesh*> meshes;
+    for (const auto &pInstance : pSimpleScene->instances()) {
+        if (auto pMesh = dynamic_cast<const Mesh*>(pInstance->target());
+            (pMesh != nullptr) && (std::find(meshes.begin(), meshes.end(), pMesh) == meshes.end())) {
+            meshes.push_back(pMesh);
+        }
+    }
+    
+    for (auto pMesh : meshes) {
+        const auto &stats = pMesh->bvhStats();
+        auto pAssimpMesh = dynamic_cast<const AssimpMesh*>(pMesh);
+        printf("mesh: triangles=%d, references=%d, nodes=%d, wide_nodes=%d, build_time=%.3fs, memory=%.2fMB, compact=%d, cached=%d\n",
+               (int)stats.m_uPrimitives, (int)stats.m_uReferences, (int)stats.m_uNodes, (int)stats.m_uWideNodes, stats.m_fBuildTimeS,
+               pMesh->memoryUsage() / 1048576.0f, (int)pMesh->isCompact(), (int)((pAssimpMesh != nullptr) && pAssimpMesh->fromCache()));
+    }
+    
+    if (auto pBvhScene = dynamic_cast<const SimpleSceneBvh*>(pSimpleScene); pBvhScene != nullptr) {
+        const auto &stats = pBvhScene->bvhStats();
+        printf("scene tlas: instances=%d, blas=%d, nodes=%d, wide_nodes=%d, build_time=%.3fs\n",
+               (int)pSimpleScene->instances().size(), (int)pBvhScene->blasCount(), (int)stats.m_uNodes, (int)stats.m_uWideNodes, stats.m_fBuildTimeS);
+    }
+    
+    printf("scene: instances=%d, meshes=%d, lights=%d, load_time=%.3fs\n",
+           (int)pSimpleScene->instances().size(), (int)meshes.size(), (int)pSimpleScene->lightCount(), _fLoadTimeS);
+}
+
+
+int runFrame(const std::shared_ptr<Loader> &_pLoader, const std::string &_strOutputPath, int _iRayPacketSize, INTEGRATOR _integrator)
 {
     auto pCamera = _pLoader->loadCamera();
+    auto tpLoad = clock_type::now();
     auto pScene = _pLoader->loadScene();
+    printSceneStats(pScene.get(), std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - tpLoad).count() * 1e-09f);
+    
     auto tpInit = clock_type::now();
     auto pSource = std::make_unique<Frame>(width, height,
                                            pCamera.get(),
@@ -49,22 +97,74 @@ int runFrame(const std::shared_ptr<Loader> &_pLoader, const std::string &_strOut
                                            numWorkers,
                                            maxSamplesPerPixel,
                                            maxTraceDepth,
-                                           randSeed);
+                                           randSeed,
+                                           _iRayPacketSize,
+                                           _integrator,
+                                           minSamplesPerPixel,
+                                           adaptiveThreshold,
+                                           passSamplesPerPixel,
+                                           tileSize,
+                                           tileOrder);
 
     printf("Starting with scene ...\n");
+    const bool budget = (timeBudgetS > 0) || (noiseTarget > 0);
+    const char *stopReason = "";
+    int checkedPasses = 0;
+    auto tpPrint = clock_type::now() - std::chrono::seconds(1);
+    
     while (pSource->isFinished() == false) {
         pSource->updateFrameProgress();
-        printf("active jobs=%d, progress=%.2f, time_to_finish=%.2fs, total_time=%.2fs, rays_ps=%.2f\n",
-               (int)pSource->activeJobs(), pSource->progress(), pSource->timeToFinish(), pSource->timeTotal(), pSource->raysPerSecond());
+        float timeToFinish = pSource->timeToFinish();
         
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        if (budget == true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            
+            // time budget: stop early enough for the running jobs (one line or tile pass each) to finish in time
+            if (timeBudgetS > 0) {
+                const float passTime = pSource->timeTotal() / std::max(pSource->progress() * pSource->passes(), 0.0001f);
+                const float drainTime = passTime * numWorkers / std::max(pSource->jobsPerPass(), (size_t)1);
+                timeToFinish = std::min(timeToFinish, timeBudgetS - pSource->timeTotal());
+                
+                if ( (*stopReason == 0) && (pSource->timeTotal() + drainTime >= timeBudgetS) ) {
+                    stopReason = "time budget";
+                    pSource->stop();
+                }
+            }
+            
+            // noise target: checked once per completed pass (needs two passes)
+            if ( (noiseTarget > 0) && (pSource->completedPasses() > checkedPasses) ) {
+                checkedPasses = pSource->completedPasses();
+                const float noise = pSource->noiseEstimate();
+                if ( (*stopReason == 0) && (noise >= 0) && (noise <= noiseTarget) ) {
+                    stopReason = "noise target";
+                    pSource->stop();
+                }
+            }
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+        
+        if (clock_type::now() - tpPrint >= std::chrono::milliseconds(500)) {
+            printf("active jobs=%d, progress=%.2f, passes=%d/%d, time_to_finish=%.2fs, total_time=%.2fs, rays_ps=%.2f\n",
+                   (int)pSource->activeJobs(), pSource->progress(), pSource->completedPasses(), pSource->passes(),
+                   std::max(timeToFinish, 0.0f), pSource->timeTotal(), pSource->raysPerSecond());
+            tpPrint = clock_type::now();
+        }
     }
     
+    pSource->updateFrameProgress();
     pSource->writeToFile(_strOutputPath);
     
     auto td = clock_type::now() - tpInit;
     auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(td).count();
-    printf("Done %.2fs\n", (float)ns/1e09);
+    if (*stopReason != 0) {
+        printf("Stopped on %s after %d passes\n", stopReason, pSource->completedPasses());
+    }
+    
+    printf("Done %.2fs, rays_ps=%.2f, ray_packet_size=%d, integrator=%d, spp=%d, avg_spp=%.2f, noise=%.4f\n",
+           (float)ns/1e09, pSource->raysPerSecond(), _iRayPacketSize, (int)_integrator, maxSamplesPerPixel, pSource->samplesPerPixel(),
+           pSource->noiseEstimate());
     
     return 0;
 }
@@ -85,30 +185,106 @@ std::shared_ptr<Loader> findScenarioLoader(const std::string &_strLoaderName) {
 
 int main(int argc, char *argv[])
 {
-    // parse command line
-    std::string scenario;
-    std::string output;
+    // parse command line: [options] [scenario|all] [output]
+    //  all             runs every scene, saving to '<scene>_<output>'
+    //  --packet=N      trace primary rays in packets of N (4, 8, 16, ...; 0 traces single rays)
+    //  --wavefront     use the wavefront integrator (paths advanced one bounce at a time)
+    //  --sort-rays     use the wavefront integrator and sort secondary rays by direction and origin
+    //  --lights        sample lights at every hit, combined with scattered rays (MIS; needs far fewer samples per pixel)
+    //  --spp=N         samples per pixel (maximum with adaptive sampling)
+    //  --adaptive=T    adaptive sampling: stop once the 95% confidence interval of pixel luminance is within T
+    //                  (relative to the mean, e.g. 0.05)
+    //  --min-spp=N     minimum samples per pixel with adaptive sampling
+    //  --pass-spp=N    progressive rendering: render in passes of N samples per pixel over the whole image
+    //  --time=S        render progressively until S seconds are spent, then write the image
+    //  --noise=N       render progressively until the estimated image noise is below N (e.g. 0.01), then write the image
+    //                  (with --time or --noise, --spp is the maximum, default 4096, and --pass-spp defaults to 1)
+    //  --tile=N        render N x N tiles in Hilbert curve order instead of lines (e.g. 16, 32)
+    //  --morton        issue tiles in Morton (Z) order
+    //  --model=PATH    model file imported by 'model_scene' (all meshes and nodes; default models/dragon_1.obj)
+    std::vector<std::string> args;
+    int rayPacketSize = 0;
+    bool bSamplesSet = false;
+    std::string modelPath;
+    INTEGRATOR integrator = INTEGRATOR::PATH;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--packet=", 0) == 0) {
+            rayPacketSize = std::max(0, std::atoi(arg.c_str() + 9));
+        }
+        else if (arg == "--wavefront") {
+            integrator = INTEGRATOR::WAVEFRONT;
+        }
+        else if (arg == "--sort-rays") {
+            integrator = INTEGRATOR::SORTED;
+        }
+        else if (arg == "--lights") {
+            integrator = INTEGRATOR::LIGHTS;
+        }
+        else if (arg.rfind("--spp=", 0) == 0) {
+            maxSamplesPerPixel = std::max(1, std::atoi(arg.c_str() + 6));
+            bSamplesSet = true;
+        }
+        else if (arg.rfind("--adaptive=", 0) == 0) {
+            adaptiveThreshold = std::max(0.0f, (float)std::atof(arg.c_str() + 11));
+        }
+        else if (arg.rfind("--min-spp=", 0) == 0) {
+            minSamplesPerPixel = std::max(2, std::atoi(arg.c_str() + 10));
+        }
+        else if (arg.rfind("--pass-spp=", 0) == 0) {
+            passSamplesPerPixel = std::max(0, std::atoi(arg.c_str() + 11));
+        }
+        else if (arg.rfind("--tile=", 0) == 0) {
+            tileSize = std::max(0, std::atoi(arg.c_str() + 7));
+        }
+        else if (arg == "--morton") {
+            tileOrder = TILE_ORDER::MORTON;
+        }
+        else if (arg.rfind("--time=", 0) == 0) {
+            timeBudgetS = std::max(0.0f, (float)std::atof(arg.c_str() + 7));
+        }
+        else if (arg.rfind("--noise=", 0) == 0) {
+            noiseTarget = std::max(0.0f, (float)std::atof(arg.c_str() + 8));
+        }
+        else if (arg.rfind("--model=", 0) == 0) {
+            modelPath = arg.substr(8);
+        }
+        else {
+            args.push_back(arg);
+        }
+    }
     
-    if (argc == 3) {
-        scenario = argv[1];
-        output = argv[2];
+    // budgeted rendering runs progressive passes up to a high sample count
+    if ( (timeBudgetS > 0) || (noiseTarget > 0) ) {
+        maxSamplesPerPixel = bSamplesSet ? maxSamplesPerPixel : 4096;
+        passSamplesPerPixel = std::max(passSamplesPerPixel, 1);
+    }
+    
+    std::string scenario = args.size() > 0 ? args[0] : "default_scene";
+    std::string output = args.size() > 1 ? args[1] : "raytraced.jpeg";
+
+    if (scenario == "all") {
+        int ret = 0;
+        for (auto &pLoader : DETAIL::getSceneList()) {
+            printf("Running frame '%s'\n", pLoader->name().c_str());
+            ret |= runFrame(pLoader, pLoader->name() + "_" + output, rayPacketSize, integrator);
+        }
+        
+        return ret;
     }
-	else if (argc == 2) {
-		scenario = argv[1];
-		output = "raytraced.jpeg";
-	}
-	else if (argc == 1) {
-		scenario = "default_scene";
-		output = "raytraced.jpeg";
-	}
 
     printf("Running frame '%s' saving to '%s'\n", scenario.c_str(), output.c_str());
     
     // load and run frame
     auto pLoader = findScenarioLoader(scenario);
+    if ( (pLoader != nullptr) && (modelPath.empty() == false) && (pLoader->name() == "model_scene") ) {
+        pLoader = std::make_shared<LoaderModelScene>(modelPath);
+    }
+    
     if (pLoader != nullptr) {
         printf("Loader: %s\nDesc: %s\n", pLoader->name().c_str(), pLoader->description().c_str());
-        return runFrame(pLoader, output);
+        return runFrame(pLoader, output, rayPacketSize, integrator);
     }
     else {
         printf("Could not run frame: No scenario loader found!\n");
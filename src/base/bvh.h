@@ -4,14 +4,36 @@
 #include "core/constants.h"
 #include "core/vec3.h"
 #include "core/ray.h"
+#include "core/morton.h"
+#include "core/parallel.h"
 #include "core/queue.h"
+#include "core/simd.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <future>
+#include <limits>
+#include <memory>
 #include <vector>
 
 
 namespace BASE
 {
+    /* BVH build strategies */
+    enum class BVH_SPLIT {
+        BOUNDS = 1,     // halve bounds on longest axis until primitives fall on both sides
+        SAH = 2,        // surface area heuristic, using binned primitive centroids
+        MORTON = 3,     // linear BVH from sorted centroid morton codes (FlatBvh only; fast, lower quality)
+        SPATIAL = 4     // SAH with spatial splits, primitives may be referenced by more than one leaf (FlatBvh only)
+    };
+    
+    // default spatial split duplication budget (extra references as a fraction of primitives)
+    constexpr float BVH_MAX_DUPLICATION = 0.3f;
+    
+    
     /*
      Bounding volume hyrarchy nodes
      */
@@ -33,6 +55,9 @@ namespace BASE
         BvhNode *m_pLeft = nullptr;
         BvhNode *m_pRight = nullptr;
         const primitive_type *m_pPrimitive = nullptr;
+        uint32_t m_uPrimitiveCount = 0;      // number of primitives in subtree
+        uint32_t m_uFlatNodes = 0;           // flattened nodes of subtree (set by FlatBvh before flattening)
+        uint32_t m_uFlatIndices = 0;         // primitive indices in leaves of subtree (set by FlatBvh before flattening)
     };
 
     
@@ -74,15 +99,122 @@ namespace BASE
 
 
     /*
-     Build BVH tree recursively
+        Split primitive items into two bins (left & right) using the surface area heuristic.
+        Primitive centroids are binned along each axis and the bin boundary with the lowest
+        cost (left count * left area + right count * right area) is used.
+        Falls back to an even split if all centroids coincide.
+     */
+    template <typename primitive_type>
+    std::pair<CORE::Bounds, CORE::Bounds> splitPrimitivesSah(
+                std::vector<const primitive_type*> &_left, std::vector<const primitive_type*> &_right,
+                const std::vector<const primitive_type*> &_primitives)
+    {
+        static constexpr int BINS = 16;
+        
+        struct Bin {
+            void grow(const CORE::Bounds &_bounds) {
+                m_bounds = m_uCount > 0 ? CORE::combineBoxes(m_bounds, _bounds) : _bounds;
+                m_uCount++;
+            }
+            
+            CORE::Bounds    m_bounds;
+            size_t          m_uCount = 0;
+        };
+        
+        // find centroid bounds
+        CORE::Bounds centroidBounds = CORE::findBounds(_primitives, [](const primitive_type *_pItem){
+            auto c = _pItem->bounds().center();
+            return CORE::Bounds(c, c);
+        });
+        
+        CORE::Vec extent = centroidBounds.size();
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1;
+        int bestSplit = 0;
+        
+        auto binIndex = [&](const primitive_type *_pItem, int _iAxis) {
+            float f = (_pItem->bounds().center().m_v[_iAxis] - centroidBounds.m_min.m_v[_iAxis]) / extent.m_v[_iAxis];
+            return std::min((int)(f * BINS), BINS - 1);
+        };
+        
+        for (int axis = 0; axis < 3; axis++) {
+            if (extent.m_v[axis] <= 0) {
+                continue;
+            }
+            
+            // bin primitives
+            std::array<Bin, BINS> bins;
+            for (const auto &pItem : _primitives) {
+                bins[binIndex(pItem, axis)].grow(pItem->bounds());
+            }
+            
+            // sweep from right to left to find areas right of each split
+            std::array<float, BINS> rightCost = {};
+            Bin right;
+            for (int i = BINS - 1; i > 0; i--) {
+                if (bins[i].m_uCount > 0) {
+                    right.m_bounds = right.m_uCount > 0 ? CORE::combineBoxes(right.m_bounds, bins[i].m_bounds) : bins[i].m_bounds;
+                    right.m_uCount += bins[i].m_uCount;
+                }
+                
+                rightCost[i] = right.m_uCount * right.m_bounds.surfaceArea();
+            }
+            
+            // sweep from left to right and evaluate cost of each split
+            Bin left;
+            for (int i = 0; i < BINS - 1; i++) {
+                if (bins[i].m_uCount > 0) {
+                    left.m_bounds = left.m_uCount > 0 ? CORE::combineBoxes(left.m_bounds, bins[i].m_bounds) : bins[i].m_bounds;
+                    left.m_uCount += bins[i].m_uCount;
+                }
+                
+                if ( (left.m_uCount > 0) && (left.m_uCount < _primitives.size()) ) {
+                    float cost = left.m_uCount * left.m_bounds.surfaceArea() + rightCost[i + 1];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = i + 1;
+                    }
+                }
+            }
+        }
+        
+        _left.clear();
+        _right.clear();
+        
+        if (bestAxis < 0) {
+            CORE::splitItems(_left, _right, _primitives);
+        }
+        else {
+            for (const auto &pItem : _primitives) {
+                if (binIndex(pItem, bestAxis) < bestSplit) _left.push_back(pItem);
+                else _right.push_back(pItem);
+            }
+        }
+        
+        auto boundsFunc = [](const primitive_type *_pItem){return _pItem->bounds();};
+        return std::make_pair(CORE::findBounds(_left, boundsFunc), CORE::findBounds(_right, boundsFunc));
+    }
+
+
+    /*
+     Build BVH tree recursively.
+     While _iTaskDepth > 0, large left subtrees are built on a separate task (the create function
+     then has to be thread-safe).
      */
     template <typename primitive_type, typename create_func>
     BvhNode<primitive_type> *buildBvhNode(const std::vector<const primitive_type*> &_primitives,
                                           const CORE::Bounds &_splitBounds,
-                                          const create_func &_create)
+                                          const create_func &_create,
+                                          BVH_SPLIT _split = BVH_SPLIT::BOUNDS,
+                                          int _iTaskDepth = 0)
     {
+        static constexpr size_t MIN_TASK_PRIMITIVES = 4096;
+        
         // create node
         auto pNode = _create();
+        pNode->m_uPrimitiveCount = (uint32_t)_primitives.size();
+        
         if (_primitives.size() == 1) {
             pNode->m_pPrimitive = _primitives[0];
             pNode->m_bounds = pNode->m_pPrimitive->bounds();
@@ -93,19 +225,34 @@ namespace BASE
             std::vector<const primitive_type*> right;
 
             // split in left and right
-            auto boxes = splitPrimitives(left, right, _primitives, _splitBounds);
+            auto boxes = _split == BVH_SPLIT::SAH ?
+                            splitPrimitivesSah(left, right, _primitives) :
+                            splitPrimitives(left, right, _primitives, _splitBounds);
 
-            // left node: go down the tree
-            if (left.size() > 0) {
-                pNode->m_pLeft = buildBvhNode(left, boxes.first, _create);
-                boundsList.push_back(pNode->m_pLeft->m_bounds);
+            // left node: go down the tree (on a separate task for large subtrees)
+            std::future<BvhNode<primitive_type>*> leftTask;
+            if ( (_iTaskDepth > 0) && (left.size() >= MIN_TASK_PRIMITIVES) && (right.size() > 0) ) {
+                leftTask = std::async(std::launch::async, [&](){
+                    return buildBvhNode(left, boxes.first, _create, _split, _iTaskDepth - 1);
+                });
+            }
+            else if (left.size() > 0) {
+                pNode->m_pLeft = buildBvhNode(left, boxes.first, _create, _split, _iTaskDepth - 1);
             }
             
             // right node: go down the tree
             if (right.size() > 0) {
-                pNode->m_pRight = buildBvhNode(right, boxes.second, _create);
+                pNode->m_pRight = buildBvhNode(right, boxes.second, _create, _split, _iTaskDepth - 1);
                 boundsList.push_back(pNode->m_pRight->m_bounds);
             }
+            
+            if (leftTask.valid() == true) {
+                pNode->m_pLeft = leftTask.get();
+            }
+            
+            if (pNode->m_pLeft != nullptr) {
+                boundsList.push_back(pNode->m_pLeft->m_bounds);
+            }
 
             // update with actual bounds of primitives of node
             pNode->m_bounds = combineBoxes(boundsList);
@@ -120,47 +267,900 @@ namespace BASE
      */
     template <typename primitive_type, typename create_func>
     BvhNode<primitive_type> *buildBvhRoot(const std::vector<const primitive_type*> &_srcNodes,
-                                          const create_func &_create)
+                                          const create_func &_create,
+                                          BVH_SPLIT _split = BVH_SPLIT::BOUNDS,
+                                          int _iTaskDepth = 0)
     {
         CORE::Bounds bounds = CORE::findBounds(_srcNodes, [](const primitive_type *_pItem){
             return _pItem->bounds();
         });
 
-        return buildBvhNode(_srcNodes, bounds, _create);
+        return buildBvhNode(_srcNodes, bounds, _create, _split, _iTaskDepth);
     }
 
 
-    /* Search for best hit through BVH */
-    template <typename primitive_type, typename hit_func>
-    uint32_t checkBvhHit(const BvhNode<primitive_type> *_pRoot, const CORE::Ray &_ray, const hit_func &_hit)
+    /* BVH build stats */
+    struct BvhBuildStats
     {
-        CORE::Stack<BvhNode<primitive_type>*> nodes(32);
-        uint32_t boxHits = 0;
+        float       m_fBuildTimeS = 0;
+        size_t      m_uPrimitives = 0;
+        size_t      m_uReferences = 0;      // primitive references in leaves (> primitives with spatial splits)
+        size_t      m_uNodes = 0;           // binary (flattened) nodes
+        size_t      m_uWideNodes = 0;
+        float       m_fSahCost = 0;         // SAH cost of binary nodes (relative to root area)
+    };
+
+
+    /*
+     Flattened BVH node (32 bytes).
+     Nodes are stored depth-first, so the left child of an inner node directly follows it.
+     Inner nodes: m_uOffset is the index of the right child and m_uCount is 0.
+     Leaf nodes: [m_uOffset, m_uOffset + m_uCount) is the range of primitive indices.
+     */
+    struct alignas(32) BvhFlatNode
+    {
+        bool isLeaf() const {return m_uCount > 0;}
         
-        // start with root
-        nodes.push(_pRoot->m_pLeft);
-        nodes.push(_pRoot->m_pRight);
+        /* returns entry position on ray, or -1 if box is missed, behind the ray or beyond the ray max distance */
+        float intersect(const CORE::Ray &_ray) const {
+            if (auto i = aaboxIntersect(m_bounds, _ray);
+                (i.intersect() == true) && (i.m_tmax >= 0) && (i.m_tmin <= _ray.m_fMaxDist) )
+            {
+                return i.m_tmin >= 0 ? i.m_tmin : 0;
+            }
+            
+            return -1;
+        }
+        
+        CORE::Bounds    m_bounds;
+        uint32_t        m_uOffset = 0;
+        uint32_t        m_uCount = 0;
+    };
+    
+    static_assert(sizeof(BvhFlatNode) == 32, "Flat BVH nodes should be 32 bytes.");
 
-        // process nodes
-        while (nodes.empty() == false) {
-            const auto &pNode = nodes.pop();
-            if ( (pNode != nullptr) &&
-                 (pNode->intersect(_ray) >= 0) )
+
+    /*
+     Wide BVH node (N children, child bounds stored as SoA for SIMD slab tests).
+     Collapsed from the binary flattened nodes.
+     Inner children: m_uChild is the wide node index and m_uCount is 0.
+     Leaf children: [m_uChild, m_uChild + m_uCount) is the range of primitive indices.
+     */
+    template <int N>
+    struct alignas(32) BvhWideNode
+    {
+        CORE::BoundsN<N>    m_bounds;
+        uint32_t            m_uChild[N] = {};
+        uint32_t            m_uCount[N] = {};
+        uint32_t            m_uChildren = 0;      // number of valid children
+    };
+
+
+    /*
+     BVH stored as one contiguous array of flattened nodes.
+     Built from a (temporary) pointer-linked BvhNode tree. Leaves reference primitives by their
+     index in the primitive list the BVH was built from.
+     */
+    template <typename primitive_type>
+    class FlatBvh
+    {
+     public:
+        FlatBvh() noexcept = default;
+        
+        /*
+         Build tree and flatten; subtrees with at most _uMaxLeafSize primitives become one leaf.
+         Subtrees (or morton code sorting passes) run in parallel on up to _iThreads threads.
+         BVH_SPLIT::SPATIAL clips primitive bounds to boxes (see buildSpatial for exact clipping).
+         */
+        void build(const std::vector<const primitive_type*> &_primitives, BVH_SPLIT _split, uint32_t _uMaxLeafSize = 1, int _iThreads = 1) {
+            if (_split == BVH_SPLIT::SPATIAL) {
+                buildSpatial(_primitives, _uMaxLeafSize, BVH_MAX_DUPLICATION, [&](uint32_t _uIndex, const CORE::Bounds &_box){
+                    return CORE::intersectBoxes(_primitives[_uIndex]->bounds(), _box);
+                });
+                
+                return;
+            }
+            
+            auto tpStart = std::chrono::high_resolution_clock::now();
+            
+            clear();
+            if (_primitives.empty() == true) {
+                return;
+            }
+            
+            if (_split == BVH_SPLIT::MORTON) {
+                buildLinear(_primitives, std::max(_uMaxLeafSize, 1u), _iThreads);
+            }
+            else {
+                buildRecursive(_primitives, _split, std::max(_uMaxLeafSize, 1u), _iThreads);
+            }
+            
+            finishBuild(_primitives.size(), tpStart);
+        }
+        
+        /*
+         Build spatial split BVH (SBVH).
+         At each node the best binned SAH object split is compared with the best spatial split, where
+         primitives straddling the split plane are referenced from both children. Spatial splits are
+         only tried while object split children overlap, and while the duplication budget (extra
+         references as a fraction of the primitive count) lasts.
+         _clip(index, box) returns the bounds of the part of primitive [index] inside box.
+         */
+        template <typename clip_func>
+        void buildSpatial(const std::vector<const primitive_type*> &_primitives, uint32_t _uMaxLeafSize, float _fMaxDuplication, const clip_func &_clip) {
+            auto tpStart = std::chrono::high_resolution_clock::now();
+            
+            clear();
+            if (_primitives.empty() == true) {
+                return;
+            }
+            
+            SpatialContext<clip_func> context{_clip, std::max(_uMaxLeafSize, 1u), (size_t)(_primitives.size() * std::max(_fMaxDuplication, 0.0f))};
+            
+            std::vector<SpatialRef> refs(_primitives.size());
+            for (size_t i = 0; i < _primitives.size(); i++) {
+                refs[i].m_bounds = _primitives[i]->bounds();
+                refs[i].m_uIndex = (uint32_t)i;
+            }
+            
+            context.m_fRootArea = std::max(CORE::findBounds(refs, [](const SpatialRef &_ref){return _ref.m_bounds;}).surfaceArea(),
+                                           std::numeric_limits<float>::min());
+            
+            m_nodes.reserve(2 * (_primitives.size() / context.m_uMaxLeafSize) + 1);
+            m_indices.reserve(_primitives.size() + context.m_uBudget);
+            emitSpatialNode(refs, context, 0);
+            
+            finishBuild(_primitives.size(), tpStart);
+        }
+        
+        /*
+         Refit node bounds after primitives moved (tree topology is kept).
+         _primitives has to be the same list the BVH was built from (or reordered with it).
+         Nodes are stored depth-first (children after parents), so walking the node list backwards
+         updates children before their parents. Only leaves with primitives for which _isDirty
+         returns true (checked before their bounds are read), and their parents, are updated.
+         Returns the SAH cost of the refitted tree.
+         */
+        template <typename dirty_func>
+        float refit(const std::vector<const primitive_type*> &_primitives, const dirty_func &_isDirty) {
+            if (m_nodes.empty() == true) {
+                return 0;
+            }
+            
+            std::vector<uint8_t> changed(m_nodes.size(), 0);
+            for (size_t i = m_nodes.size(); i-- > 0; ) {
+                auto &node = m_nodes[i];
+                if (node.isLeaf() == true) {
+                    for (uint32_t j = node.m_uOffset; j < node.m_uOffset + node.m_uCount; j++) {
+                        changed[i] |= _isDirty(_primitives[m_indices[j]]) ? 1 : 0;
+                    }
+                    
+                    if (changed[i] != 0) {
+                        CORE::Bounds bounds = _primitives[m_indices[node.m_uOffset]]->bounds();
+                        for (uint32_t j = node.m_uOffset + 1; j < node.m_uOffset + node.m_uCount; j++) {
+                            bounds = CORE::combineBoxes(bounds, _primitives[m_indices[j]]->bounds());
+                        }
+                        
+                        node.m_bounds = bounds;
+                    }
+                }
+                else if ( (changed[i] = changed[i + 1] | changed[node.m_uOffset]) != 0 ) {
+                    node.m_bounds = CORE::combineBoxes(m_nodes[i + 1].m_bounds, m_nodes[node.m_uOffset].m_bounds);
+                }
+            }
+            
+            if (changed[0] != 0) {
+                m_wideNodes.clear();
+                collapseNode(0);
+            }
+            
+            return sahCost();
+        }
+        
+        /*
+         Returns the SAH cost of the binary nodes: the sum of node surface areas (relative to the root),
+         weighted by primitive count for leaves. Grows as a refitted tree degrades.
+         */
+        float sahCost() const {
+            if (m_nodes.empty() == true) {
+                return 0;
+            }
+            
+            const float rootArea = std::max(m_nodes[0].m_bounds.surfaceArea(), std::numeric_limits<float>::min());
+            float cost = 0;
+            for (const auto &node : m_nodes) {
+                cost += node.m_bounds.surfaceArea() * (node.isLeaf() ? node.m_uCount : 1);
+            }
+            
+            return cost / rootArea;
+        }
+        
+        /*
+         Reorder items (that the BVH was built from) to match leaf order.
+         Primitive indices are reset, so that leaves index the reordered items directly.
+         Items referenced by more than one leaf (spatial splits) are copied.
+         */
+        template <typename item_type>
+        void reorder(std::vector<item_type> &_items) {
+            std::vector<item_type> items;
+            items.reserve(m_indices.size());
+            
+            for (size_t i = 0; i < m_indices.size(); i++) {
+                items.push_back(_items[m_indices[i]]);
+                m_indices[i] = (uint32_t)i;
+            }
+            
+            _items = std::move(items);
+        }
+        
+        /* replace nodes, indices and stats (e.g. with data loaded from a cache) */
+        void assign(std::vector<BvhFlatNode> &&_nodes, std::vector<BvhWideNode<CORE::SIMD_WIDTH>> &&_wideNodes,
+                    std::vector<uint32_t> &&_indices, const BvhBuildStats &_stats)
+        {
+            m_nodes = std::move(_nodes);
+            m_wideNodes = std::move(_wideNodes);
+            m_indices = std::move(_indices);
+            m_stats = _stats;
+        }
+        
+        void clear() {
+            m_nodes.clear();
+            m_wideNodes.clear();
+            m_indices.clear();
+            m_stats = BvhBuildStats();
+        }
+        
+        bool empty() const {
+            return m_nodes.empty();
+        }
+        
+        const std::vector<BvhFlatNode> &nodes() const {
+            return m_nodes;
+        }
+        
+        const std::vector<BvhWideNode<CORE::SIMD_WIDTH>> &wideNodes() const {
+            return m_wideNodes;
+        }
+        
+        const std::vector<uint32_t> &indices() const {
+            return m_indices;
+        }
+        
+        const BvhBuildStats &stats() const {
+            return m_stats;
+        }
+        
+     private:
+        // primitive reference (with bounds clipped to the part inside its node) for spatial split builds
+        struct SpatialRef
+        {
+            const CORE::Bounds &bounds() const {return m_bounds;}
+            
+            CORE::Bounds    m_bounds;
+            uint32_t        m_uIndex = 0;
+        };
+        
+        template <typename clip_func>
+        struct SpatialContext
+        {
+            const clip_func     &m_clip;
+            uint32_t            m_uMaxLeafSize = 1;
+            size_t              m_uBudget = 0;          // duplicate references left
+            float               m_fRootArea = 1;
+        };
+        
+        // collapse to wide nodes and update stats
+        void finishBuild(size_t _uPrimitives, const std::chrono::high_resolution_clock::time_point &_tpStart) {
+            m_wideNodes.reserve(m_nodes.size() / 2 + 1);
+            collapseNode(0);
+            
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - _tpStart).count();
+            m_stats.m_fBuildTimeS = ns * 1e-9f;
+            m_stats.m_uPrimitives = _uPrimitives;
+            m_stats.m_uReferences = m_indices.size();
+            m_stats.m_uNodes = m_nodes.size();
+            m_stats.m_uWideNodes = m_wideNodes.size();
+            m_stats.m_fSahCost = sahCost();
+        }
+        
+        // clip reference to box; returns empty bounds if the primitive does not reach into the box
+        template <typename clip_func>
+        static CORE::Bounds clipRef(const SpatialRef &_ref, const CORE::Bounds &_box, const SpatialContext<clip_func> &_context) {
+            auto box = CORE::intersectBoxes(_ref.m_bounds, _box);
+            if (box.empty() == true) {
+                return box;
+            }
+            
+            return CORE::intersectBoxes(_context.m_clip(_ref.m_uIndex, box), box);
+        }
+        
+        // write node for references and its children depth-first; returns node index
+        template <typename clip_func>
+        uint32_t emitSpatialNode(std::vector<SpatialRef> &_refs, SpatialContext<clip_func> &_context, int _iDepth) {
+            static constexpr int BINS = 16;
+            static constexpr int MAX_DEPTH = 64;
+            static constexpr float MIN_OVERLAP = 1e-5f;     // relative to root area
+            
+            const uint32_t index = (uint32_t)m_nodes.size();
+            m_nodes.emplace_back();
+            
+            auto nodeBounds = CORE::findBounds(_refs, [](const SpatialRef &_ref){return _ref.m_bounds;});
+            m_nodes[index].m_bounds = nodeBounds;
+            
+            if ( (_refs.size() <= _context.m_uMaxLeafSize) || (_iDepth >= MAX_DEPTH) ) {
+                // leaf node
+                m_nodes[index].m_uOffset = (uint32_t)m_indices.size();
+                m_nodes[index].m_uCount = (uint32_t)_refs.size();
+                for (const auto &ref : _refs) {
+                    m_indices.push_back(ref.m_uIndex);
+                }
+                
+                return index;
+            }
+            
+            // best object split
+            std::vector<const SpatialRef*> refPtrs(_refs.size());
+            for (size_t i = 0; i < _refs.size(); i++) {
+                refPtrs[i] = &_refs[i];
+            }
+            
+            std::vector<const SpatialRef*> objectLeft, objectRight;
+            auto objectBoxes = splitPrimitivesSah(objectLeft, objectRight, refPtrs);
+            const float objectCost = objectBoxes.first.surfaceArea() * objectLeft.size() + objectBoxes.second.surfaceArea() * objectRight.size();
+            
+            // best spatial split (only where object split children overlap)
+            float spatialCost = std::numeric_limits<float>::max();
+            int spatialAxis = -1;
+            float spatialPlane = 0;
+            CORE::Bounds spatialLeft, spatialRight;
+            size_t spatialLeftCount = 0, spatialRightCount = 0;
+            
+            auto overlap = CORE::intersectBoxes(objectBoxes.first, objectBoxes.second);
+            if ( (_context.m_uBudget > 0) &&
+                 (overlap.empty() == false) &&
+                 (overlap.surfaceArea() > MIN_OVERLAP * _context.m_fRootArea) )
+            {
+                struct Bin {
+                    void grow(const CORE::Bounds &_bounds) {
+                        m_bounds = m_bValid ? CORE::combineBoxes(m_bounds, _bounds) : _bounds;
+                        m_bValid = true;
+                    }
+                    
+                    CORE::Bounds    m_bounds;
+                    bool            m_bValid = false;
+                    size_t          m_uEntries = 0;
+                    size_t          m_uExits = 0;
+                };
+                
+                for (int axis = 0; axis < 3; axis++) {
+                    const float origin = nodeBounds.m_min.m_v[axis];
+                    const float binSize = (nodeBounds.m_max.m_v[axis] - origin) / BINS;
+                    if (binSize <= 0) {
+                        continue;
+                    }
+                    
+                    auto binIndex = [&](float _fPos) {
+                        return std::clamp((int)((_fPos - origin) / binSize), 0, BINS - 1);
+                    };
+                    
+                    // clip references into the bins they span
+                    std::array<Bin, BINS> bins;
+                    for (const auto &ref : _refs) {
+                        const int first = binIndex(ref.m_bounds.m_min.m_v[axis]);
+                        const int last = binIndex(ref.m_bounds.m_max.m_v[axis]);
+                        
+                        for (int b = first; b <= last; b++) {
+                            auto box = ref.m_bounds;
+                            if (b > first) box.m_min.m_v[axis] = origin + binSize * b;
+                            if (b < last) box.m_max.m_v[axis] = origin + binSize * (b + 1);
+                            
+                            if (auto clipped = first == last ? ref.m_bounds : clipRef(ref, box, _context); clipped.empty() == false) {
+                                bins[b].grow(clipped);
+                            }
+                        }
+                        
+                        bins[first].m_uEntries++;
+                        bins[last].m_uExits++;
+                    }
+                    
+                    // sweep from right to left to find areas right of each plane
+                    std::array<float, BINS> rightArea = {};
+                    std::array<size_t, BINS> rightCount = {};
+                    Bin right;
+                    size_t count = 0;
+                    for (int i = BINS - 1; i > 0; i--) {
+                        if (bins[i].m_bValid == true) {
+                            right.grow(bins[i].m_bounds);
+                        }
+                        
+                        count += bins[i].m_uExits;
+                        rightArea[i] = right.m_bValid ? right.m_bounds.surfaceArea() : 0;
+                        rightCount[i] = count;
+                    }
+                    
+                    // sweep from left to right and evaluate cost of each plane
+                    Bin left;
+                    count = 0;
+                    for (int i = 0; i < BINS - 1; i++) {
+                        if (bins[i].m_bValid == true) {
+                            left.grow(bins[i].m_bounds);
+                        }
+                        
+                        count += bins[i].m_uEntries;
+                        if ( (count > 0) && (rightCount[i + 1] > 0) && (left.m_bValid == true) ) {
+                            float cost = left.m_bounds.surfaceArea() * count + rightArea[i + 1] * rightCount[i + 1];
+                            if (cost < spatialCost) {
+                                spatialCost = cost;
+                                spatialAxis = axis;
+                                spatialPlane = origin + binSize * (i + 1);
+                                spatialLeft = left.m_bounds;
+                                spatialLeftCount = count;
+                                spatialRightCount = rightCount[i + 1];
+                                
+                                spatialRight = CORE::Bounds();
+                                bool bValid = false;
+                                for (int j = i + 1; j < BINS; j++) {
+                                    if (bins[j].m_bValid == true) {
+                                        spatialRight = bValid ? CORE::combineBoxes(spatialRight, bins[j].m_bounds) : bins[j].m_bounds;
+                                        bValid = true;
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            
+            std::vector<SpatialRef> left, right;
+            if ( (spatialAxis >= 0) && (spatialCost < objectCost) ) {
+                // spatial split: straddling references go to one or both sides (cheapest by SAH)
+                const int axis = spatialAxis;
+                const float leftArea = spatialLeft.surfaceArea();
+                const float rightArea = spatialRight.surfaceArea();
+                
+                for (const auto &ref : _refs) {
+                    if (ref.m_bounds.m_max.m_v[axis] <= spatialPlane) {
+                        left.push_back(ref);
+                    }
+                    else if (ref.m_bounds.m_min.m_v[axis] >= spatialPlane) {
+                        right.push_back(ref);
+                    }
+                    else {
+                        auto leftBox = ref.m_bounds;
+                        leftBox.m_max.m_v[axis] = spatialPlane;
+                        auto rightBox = ref.m_bounds;
+                        rightBox.m_min.m_v[axis] = spatialPlane;
+                        
+                        const auto leftClip = clipRef(ref, leftBox, _context);
+                        const auto rightClip = clipRef(ref, rightBox, _context);
+                        
+                        if (leftClip.empty() == true) {
+                            right.push_back(ref);
+                        }
+                        else if (rightClip.empty() == true) {
+                            left.push_back(ref);
+                        }
+                        else {
+                            // compare duplicating with moving the whole reference to either side
+                            const float splitCost = leftArea * spatialLeftCount + rightArea * spatialRightCount;
+                            const float leftOnlyCost = CORE::combineBoxes(spatialLeft, ref.m_bounds).surfaceArea() * spatialLeftCount + rightArea * (spatialRightCount - 1);
+                            const float rightOnlyCost = leftArea * (spatialLeftCount - 1) + CORE::combineBoxes(spatialRight, ref.m_bounds).surfaceArea() * spatialRightCount;
+                            
+                            if ( (_context.m_uBudget > 0) && (splitCost < leftOnlyCost) && (splitCost < rightOnlyCost) ) {
+                                left.push_back(SpatialRef{leftClip, ref.m_uIndex});
+                                right.push_back(SpatialRef{rightClip, ref.m_uIndex});
+                                _context.m_uBudget--;
+                            }
+                            else if (leftOnlyCost <= rightOnlyCost) {
+                                left.push_back(ref);
+                            }
+                            else {
+                                right.push_back(ref);
+                            }
+                        }
+                    }
+                }
+            }
+            
+            if ( (left.empty() == true) || (right.empty() == true) ||
+                 (left.size() >= _refs.size()) || (right.size() >= _refs.size()) )
+            {
+                // object split
+                left.clear();
+                right.clear();
+                for (const auto &pRef : objectLeft) left.push_back(*pRef);
+                for (const auto &pRef : objectRight) right.push_back(*pRef);
+            }
+            
+            // release node references before going down the tree
+            std::vector<SpatialRef>().swap(_refs);
+            std::vector<const SpatialRef*>().swap(refPtrs);
+            objectLeft.clear();
+            objectRight.clear();
+            
+            emitSpatialNode(left, _context, _iDepth + 1);
+            m_nodes[index].m_uOffset = emitSpatialNode(right, _context, _iDepth + 1);
+            return index;
+        }
+        
+        /*
+         Build pointer-linked tree with recursive splits and flatten it.
+         Tree nodes come from a pool sized for the largest possible tree (2n - 1 nodes with one primitive per
+         leaf), so subtree tasks take nodes with an atomic counter instead of sharing a lock. Flattening counts
+         nodes and indices per subtree first, so that large subtrees are written in parallel to their final place.
+         */
+        void buildRecursive(const std::vector<const primitive_type*> &_primitives, BVH_SPLIT _split, uint32_t _uMaxLeafSize, int _iThreads) {
+            static constexpr size_t MIN_CHUNK_SIZE = 16384;
+            
+            // each task level doubles the number of threads used
+            int taskDepth = 0;
+            while ((1 << taskDepth) < _iThreads) {
+                taskDepth++;
+            }
+            
+            std::vector<BvhNode<primitive_type>> pool(2 * _primitives.size() - 1);
+            std::atomic<size_t> poolUsed(0);
+            auto pRoot = buildBvhRoot(_primitives,
+                                      [&](){
+                                          const size_t index = poolUsed.fetch_add(1, std::memory_order_relaxed);
+                                          assert(index < pool.size());
+                                          return &pool[index];
+                                      },
+                                      _split,
+                                      taskDepth);
+            
+            countFlatNodes(pRoot, _uMaxLeafSize, taskDepth);
+            m_nodes.resize(pRoot->m_uFlatNodes);
+            m_indices.resize(pRoot->m_uFlatIndices);
+            
+            // leaves reference primitives by address (with their index position)
+            std::vector<std::pair<uint64_t, uint32_t>> leafPrimitives(m_indices.size());
+            flattenNode(pRoot, 0, 0, leafPrimitives, _uMaxLeafSize, taskDepth);
+            
+            // resolve addresses to primitive indices: join both lists sorted by address
+            std::vector<std::pair<uint64_t, uint32_t>> primitiveIndices(_primitives.size());
+            CORE::parallelFor(_primitives.size(), _iThreads, MIN_CHUNK_SIZE, [&](size_t, size_t _uBegin, size_t _uEnd) {
+                for (size_t i = _uBegin; i < _uEnd; i++) {
+                    primitiveIndices[i] = std::make_pair((uint64_t)(uintptr_t)_primitives[i], (uint32_t)i);
+                }
+            });
+            
+            CORE::radixSort(primitiveIndices, _iThreads);
+            CORE::radixSort(leafPrimitives, _iThreads);
+            
+            CORE::parallelFor(leafPrimitives.size(), _iThreads, MIN_CHUNK_SIZE, [&](size_t, size_t _uBegin, size_t _uEnd) {
+                auto it = std::lower_bound(primitiveIndices.begin(), primitiveIndices.end(), leafPrimitives[_uBegin].first,
+                                           [](const auto &_entry, uint64_t _uKey){return _entry.first < _uKey;});
+                for (size_t i = _uBegin; i < _uEnd; i++) {
+                    while (it->first < leafPrimitives[i].first) {
+                        ++it;
+                    }
+                    
+                    m_indices[leafPrimitives[i].second] = it->second;
+                }
+            });
+        }
+        
+        /*
+         Build linear BVH: sort primitives on the morton codes of their centroids and emit flat nodes
+         directly (depth-first), splitting each range where the highest differing code bit changes.
+         */
+        void buildLinear(const std::vector<const primitive_type*> &_primitives, uint32_t _uMaxLeafSize, int _iThreads) {
+            CORE::Bounds centroidBounds = CORE::findBounds(_primitives, [](const primitive_type *_pItem){
+                auto c = _pItem->bounds().center();
+                return CORE::Bounds(c, c);
+            });
+            
+            std::vector<std::pair<uint64_t, uint32_t>> codes(_primitives.size());
+            for (size_t i = 0; i < _primitives.size(); i++) {
+                codes[i] = std::make_pair(CORE::mortonCode(_primitives[i]->bounds().center(), centroidBounds), (uint32_t)i);
+            }
+            
+            CORE::radixSort(codes, _iThreads);
+            
+            m_indices.resize(codes.size());
+            for (size_t i = 0; i < codes.size(); i++) {
+                m_indices[i] = codes[i].second;
+            }
+            
+            m_nodes.reserve(2 * (_primitives.size() / _uMaxLeafSize) + 1);
+            emitLinearNode(_primitives, codes, 0, (uint32_t)codes.size(), _uMaxLeafSize);
+        }
+        
+        // write node for sorted range [_uBegin, _uEnd) and its children depth-first; returns node index
+        uint32_t emitLinearNode(const std::vector<const primitive_type*> &_primitives,
+                                const std::vector<std::pair<uint64_t, uint32_t>> &_codes,
+                                uint32_t _uBegin, uint32_t _uEnd, uint32_t _uMaxLeafSize)
+        {
+            const uint32_t index = (uint32_t)m_nodes.size();
+            m_nodes.emplace_back();
+            
+            if (_uEnd - _uBegin <= _uMaxLeafSize) {
+                // leaf node
+                CORE::Bounds bounds = _primitives[m_indices[_uBegin]]->bounds();
+                for (uint32_t i = _uBegin + 1; i < _uEnd; i++) {
+                    bounds = CORE::combineBoxes(bounds, _primitives[m_indices[i]]->bounds());
+                }
+                
+                m_nodes[index].m_bounds = bounds;
+                m_nodes[index].m_uOffset = _uBegin;
+                m_nodes[index].m_uCount = _uEnd - _uBegin;
+            }
+            else {
+                // split where the highest differing bit flips (or in the middle for equal codes)
+                uint32_t split = (_uBegin + _uEnd) / 2;
+                const uint64_t first = _codes[_uBegin].first;
+                const uint64_t last = _codes[_uEnd - 1].first;
+                if (first != last) {
+                    const uint64_t prefixMask = ~0ull << CORE::highestBit(first ^ last);
+                    auto it = std::partition_point(_codes.begin() + _uBegin, _codes.begin() + _uEnd, [&](const auto &_code){
+                        return (_code.first & prefixMask) == (first & prefixMask);
+                    });
+                    
+                    split = (uint32_t)(it - _codes.begin());
+                }
+                
+                emitLinearNode(_primitives, _codes, _uBegin, split, _uMaxLeafSize);
+                m_nodes[index].m_uOffset = emitLinearNode(_primitives, _codes, split, _uEnd, _uMaxLeafSize);
+                m_nodes[index].m_bounds = CORE::combineBoxes(m_nodes[index + 1].m_bounds, m_nodes[m_nodes[index].m_uOffset].m_bounds);
+            }
+            
+            return index;
+        }
+        
+        // returns the subtree node that is flattened in place of _pNode (inner nodes with only one child are skipped)
+        static BvhNode<primitive_type> *flatSubtree(BvhNode<primitive_type> *_pNode) {
+            while ( (_pNode->m_pPrimitive == nullptr) &&
+                    ((_pNode->m_pLeft == nullptr) != (_pNode->m_pRight == nullptr)) )
             {
-                boxHits++;
+                _pNode = _pNode->m_pLeft != nullptr ? _pNode->m_pLeft : _pNode->m_pRight;
+            }
+            
+            return _pNode;
+        }
+        
+        // returns true if the subtree is flattened to one leaf
+        static bool isFlatLeaf(const BvhNode<primitive_type> *_pNode, uint32_t _uMaxLeafSize) {
+            return (_pNode->m_pPrimitive != nullptr) || (_pNode->m_uPrimitiveCount <= _uMaxLeafSize);
+        }
+        
+        // set flattened node and index counts of subtree (large left subtrees on separate tasks)
+        static void countFlatNodes(BvhNode<primitive_type> *_pNode, uint32_t _uMaxLeafSize, int _iTaskDepth) {
+            static constexpr size_t MIN_TASK_PRIMITIVES = 4096;
+            
+            auto pNode = flatSubtree(_pNode);
+            if ( (pNode->m_pLeft == nullptr) && (pNode->m_pRight == nullptr) ) {
+                pNode->m_uFlatNodes = pNode->m_pPrimitive != nullptr ? 1 : 0;
+                pNode->m_uFlatIndices = pNode->m_uFlatNodes;
+            }
+            else if (isFlatLeaf(pNode, _uMaxLeafSize) == true) {
+                countFlatNodes(pNode->m_pLeft, _uMaxLeafSize, 0);
+                countFlatNodes(pNode->m_pRight, _uMaxLeafSize, 0);
+                pNode->m_uFlatNodes = 1;
+                pNode->m_uFlatIndices = pNode->m_pLeft->m_uFlatIndices + pNode->m_pRight->m_uFlatIndices;
+            }
+            else {
+                std::future<void> leftTask;
+                if ( (_iTaskDepth > 0) && (pNode->m_pLeft->m_uPrimitiveCount >= MIN_TASK_PRIMITIVES) ) {
+                    leftTask = std::async(std::launch::async, [&](){
+                        countFlatNodes(pNode->m_pLeft, _uMaxLeafSize, _iTaskDepth - 1);
+                    });
+                }
+                else {
+                    countFlatNodes(pNode->m_pLeft, _uMaxLeafSize, _iTaskDepth - 1);
+                }
+                
+                countFlatNodes(pNode->m_pRight, _uMaxLeafSize, _iTaskDepth - 1);
+                if (leftTask.valid() == true) {
+                    leftTask.get();
+                }
+                
+                pNode->m_uFlatNodes = 1 + pNode->m_pLeft->m_uFlatNodes + pNode->m_pRight->m_uFlatNodes;
+                pNode->m_uFlatIndices = pNode->m_pLeft->m_uFlatIndices + pNode->m_pRight->m_uFlatIndices;
+            }
+            
+            _pNode->m_uFlatNodes = pNode->m_uFlatNodes;
+            _pNode->m_uFlatIndices = pNode->m_uFlatIndices;
+        }
+        
+        // write addresses of all primitives under node (depth-first) from _uIndex on; returns the next index
+        static uint32_t collectPrimitives(const BvhNode<primitive_type> *_pNode, uint32_t _uIndex,
+                                          std::vector<std::pair<uint64_t, uint32_t>> &_leafPrimitives)
+        {
+            if (_pNode == nullptr) {
+                return _uIndex;
+            }
+            else if (_pNode->m_pPrimitive != nullptr) {
+                _leafPrimitives[_uIndex] = std::make_pair((uint64_t)(uintptr_t)_pNode->m_pPrimitive, _uIndex);
+                return _uIndex + 1;
+            }
+            else {
+                _uIndex = collectPrimitives(_pNode->m_pLeft, _uIndex, _leafPrimitives);
+                return collectPrimitives(_pNode->m_pRight, _uIndex, _leafPrimitives);
+            }
+        }
+        
+        /*
+         Write node and its children depth-first, starting at node _uNode and primitive index _uIndex
+         (subtree counts are set by countFlatNodes). Leaf primitives are written to _leafPrimitives by address
+         and resolved to indices afterwards. Large left subtrees are written on separate tasks.
+         */
+        void flattenNode(BvhNode<primitive_type> *_pNode, uint32_t _uNode, uint32_t _uIndex,
+                         std::vector<std::pair<uint64_t, uint32_t>> &_leafPrimitives,
+                         uint32_t _uMaxLeafSize, int _iTaskDepth)
+        {
+            static constexpr size_t MIN_TASK_PRIMITIVES = 4096;
+            
+            auto pNode = flatSubtree(_pNode);
+            if (pNode->m_uFlatNodes == 0) {
+                return;
+            }
+            
+            auto &node = m_nodes[_uNode];
+            node.m_bounds = pNode->m_bounds;
+            
+            if (isFlatLeaf(pNode, _uMaxLeafSize) == true) {
+                // leaf node
+                node.m_uOffset = _uIndex;
+                node.m_uCount = pNode->m_uFlatIndices;
+                collectPrimitives(pNode, _uIndex, _leafPrimitives);
+            }
+            else {
+                // inner node (left child follows directly)
+                auto pLeft = pNode->m_pLeft;
+                node.m_uOffset = _uNode + 1 + pLeft->m_uFlatNodes;
                 
-                if (pNode->m_pPrimitive != nullptr) {
-                    _hit(pNode->m_pPrimitive, _ray);
+                std::future<void> leftTask;
+                if ( (_iTaskDepth > 0) && (pLeft->m_uPrimitiveCount >= MIN_TASK_PRIMITIVES) ) {
+                    leftTask = std::async(std::launch::async, [&](){
+                        flattenNode(pLeft, _uNode + 1, _uIndex, _leafPrimitives, _uMaxLeafSize, _iTaskDepth - 1);
+                    });
                 }
                 else {
-                    if (pNode->m_pLeft != nullptr){
-                        nodes.push(pNode->m_pLeft);
+                    flattenNode(pLeft, _uNode + 1, _uIndex, _leafPrimitives, _uMaxLeafSize, _iTaskDepth - 1);
+                }
+                
+                flattenNode(pNode->m_pRight, node.m_uOffset, _uIndex + pLeft->m_uFlatIndices, _leafPrimitives, _uMaxLeafSize, _iTaskDepth - 1);
+                if (leftTask.valid() == true) {
+                    leftTask.get();
+                }
+            }
+        }
+        
+        /*
+         Collapse binary node (and subtree) into wide nodes; returns wide node index.
+         Inner children with the largest surface area are opened up until the node is full.
+         */
+        uint32_t collapseNode(uint32_t _uNode) {
+            constexpr int N = CORE::SIMD_WIDTH;
+            std::array<uint32_t, N> children = {};
+            int count = 0;
+            
+            if (m_nodes[_uNode].isLeaf() == true) {
+                children[count++] = _uNode;
+            }
+            else {
+                children[count++] = _uNode + 1;
+                children[count++] = m_nodes[_uNode].m_uOffset;
+            }
+            
+            while (count < N) {
+                int best = -1;
+                float bestArea = -1;
+                for (int i = 0; i < count; i++) {
+                    const auto &node = m_nodes[children[i]];
+                    if ( (node.isLeaf() == false) && (node.m_bounds.surfaceArea() > bestArea) ) {
+                        best = i;
+                        bestArea = node.m_bounds.surfaceArea();
                     }
+                }
+                
+                if (best < 0) {
+                    break;  // only leaves left
+                }
+                
+                const uint32_t open = children[best];
+                children[best] = open + 1;
+                children[count++] = m_nodes[open].m_uOffset;
+            }
+            
+            const uint32_t index = (uint32_t)m_wideNodes.size();
+            m_wideNodes.emplace_back();
+            m_wideNodes[index].m_uChildren = (uint32_t)count;
+            
+            for (int i = 0; i < count; i++) {
+                const auto &node = m_nodes[children[i]];
+                uint32_t child = node.m_uOffset;
+                if (node.isLeaf() == false) {
+                    child = collapseNode(children[i]);
+                }
+                
+                auto &wideNode = m_wideNodes[index];
+                wideNode.m_bounds.set(i, node.m_bounds);
+                wideNode.m_uChild[i] = child;
+                wideNode.m_uCount[i] = node.m_uCount;
+            }
+            
+            return index;
+        }
+        
+     private:
+        std::vector<BvhFlatNode>                        m_nodes;
+        std::vector<BvhWideNode<CORE::SIMD_WIDTH>>      m_wideNodes;
+        std::vector<uint32_t>                           m_indices;
+        BvhBuildStats                                   m_stats;
+    };
+
+
+    /*
+     Search for closest hit through BVH (wide nodes).
+     Child boxes of a node are tested together, hit children are visited front-to-back and nodes that
+     start beyond the closest hit so far are skipped.
+     The leaf function receives the leaf range [first, first + count) in the BVH index list and the ray
+     (with m_fMaxDist limited to the closest hit so far), and returns the position on the ray of a new
+     closest hit in the leaf, or a negative value on a miss.
+     */
+    template <typename primitive_type, typename leaf_func>
+    uint32_t checkBvhLeafHit(const FlatBvh<primitive_type> &_bvh, const CORE::Ray &_ray, const leaf_func &_leaf)
+    {
+        constexpr int N = CORE::SIMD_WIDTH;
+        struct StackEntry {
+            uint32_t    m_uChild;
+            uint32_t    m_uCount;
+            float       m_fEntry;
+        };
+        
+        if (_bvh.empty() == true) {
+            return 0;
+        }
+        
+        const auto &bvhNodes = _bvh.wideNodes();
+        CORE::Stack<StackEntry> nodes(64);
+        CORE::Ray ray(_ray);
+        uint32_t boxHits = 0;
+        
+        // start with root
+        nodes.push(StackEntry{0, 0, 0.0f});
+
+        // process nodes
+        while (nodes.empty() == false) {
+            const StackEntry entry = nodes.pop();
+            if (entry.m_fEntry > ray.m_fMaxDist) {
+                continue;   // node starts beyond closest hit
+            }
+            
+            if (entry.m_uCount > 0) {
+                // leaf
+                if (float t = _leaf(entry.m_uChild, entry.m_uCount, ray); (t >= 0) && (t < ray.m_fMaxDist)) {
+                    ray.m_fMaxDist = t;
+                }
+            }
+            else {
+                // test all children at once
+                const auto &node = bvhNodes[entry.m_uChild];
+                alignas(32) float entries[N];
+                uint32_t mask = CORE::aaboxIntersect(node.m_bounds, ray.m_origin, ray.m_invDirection, ray.m_fMaxDist, entries);
+                mask &= (1u << node.m_uChildren) - 1;
+                
+                // sort hit children far to near (insertion sort), so that the nearest is processed first
+                std::array<StackEntry, N> hits;
+                int count = 0;
+                for (int i = 0; i < N; i++) {
+                    if (mask & (1u << i)) {
+                        StackEntry child{node.m_uChild[i], node.m_uCount[i], entries[i]};
+                        int j = count++;
+                        for (; (j > 0) && (hits[j-1].m_fEntry < child.m_fEntry); j--) {
+                            hits[j] = hits[j-1];
+                        }
                         
-                    if (pNode->m_pRight != nullptr){
-                        nodes.push(pNode->m_pRight);
+                        hits[j] = child;
                     }
                 }
+                
+                boxHits += count;
+                for (int i = 0; i < count; i++) {
+                    nodes.push(hits[i]);
+                }
             }
         }
         
@@ -168,6 +1168,179 @@ namespace BASE
     }
 
 
+    /*
+     Search for closest hit through BVH (one primitive at a time).
+     The hit function receives the primitive index and the ray (with m_fMaxDist limited to the closest
+     hit so far) and returns the position on the ray of a new closest hit, or a negative value on a miss.
+     */
+    template <typename primitive_type, typename hit_func>
+    uint32_t checkBvhHit(const FlatBvh<primitive_type> &_bvh, const CORE::Ray &_ray, const hit_func &_hit)
+    {
+        const auto &bvhIndices = _bvh.indices();
+        return checkBvhLeafHit(_bvh, _ray, [&](uint32_t _uFirst, uint32_t _uCount, const CORE::Ray &_leafRay){
+            CORE::Ray ray(_leafRay);
+            float closest = -1;
+            for (uint32_t i = _uFirst; i < _uFirst + _uCount; i++) {
+                if (float t = _hit(bvhIndices[i], ray); (t >= 0) && (t < ray.m_fMaxDist)) {
+                    ray.m_fMaxDist = t;
+                    closest = t;
+                }
+            }
+            
+            return closest;
+        });
+    }
+
+
+    /*
+     Search for any hit through BVH (wide nodes), for occlusion queries.
+     Stops at the first leaf that reports a hit. Children are not sorted, since any hit will do.
+     The leaf function receives the leaf range [first, first + count) in the BVH index list and the ray,
+     and returns true on a hit.
+     */
+    template <typename primitive_type, typename leaf_func>
+    bool checkBvhLeafAny(const FlatBvh<primitive_type> &_bvh, const CORE::Ray &_ray, const leaf_func &_leaf)
+    {
+        constexpr int N = CORE::SIMD_WIDTH;
+        if (_bvh.empty() == true) {
+            return false;
+        }
+        
+        const auto &bvhNodes = _bvh.wideNodes();
+        CORE::Stack<uint32_t> nodes(64);
+        nodes.push(0);
+
+        while (nodes.empty() == false) {
+            const auto &node = bvhNodes[nodes.pop()];
+            alignas(32) float entries[N];
+            uint32_t mask = CORE::aaboxIntersect(node.m_bounds, _ray.m_origin, _ray.m_invDirection, _ray.m_fMaxDist, entries);
+            mask &= (1u << node.m_uChildren) - 1;
+            
+            for (; mask != 0; mask &= mask - 1) {
+                const int i = (int)CORE::lowestBit(mask);
+                if (node.m_uCount[i] == 0) {
+                    nodes.push(node.m_uChild[i]);
+                }
+                else if (_leaf(node.m_uChild[i], node.m_uCount[i], _ray) == true) {
+                    return true;
+                }
+            }
+        }
+        
+        return false;
+    }
+
+
+    /*
+     Search for any hit through BVH (one primitive at a time).
+     The hit function receives the primitive index and the ray and returns true on a hit.
+     */
+    template <typename primitive_type, typename hit_func>
+    bool checkBvhAny(const FlatBvh<primitive_type> &_bvh, const CORE::Ray &_ray, const hit_func &_hit)
+    {
+        const auto &bvhIndices = _bvh.indices();
+        return checkBvhLeafAny(_bvh, _ray, [&](uint32_t _uFirst, uint32_t _uCount, const CORE::Ray &_leafRay){
+            for (uint32_t i = _uFirst; i < _uFirst + _uCount; i++) {
+                if (_hit(bvhIndices[i], _leafRay) == true) {
+                    return true;
+                }
+            }
+            
+            return false;
+        });
+    }
+
+
+    /*
+     Search for closest hits of a packet of rays through BVH (wide nodes), sharing one traversal.
+     Every node carries a mask of the active rays whose boxes were hit on the way down; each active ray is
+     tested against the child boxes, and children are visited with the mask of rays that hit them (front-to-back
+     by the nearest entry of any of those rays).
+     The leaf function receives the leaf range [first, first + count), the ray index in the packet and the ray
+     (with m_fMaxDist limited to its closest hit so far), and returns the position on the ray of a new closest hit
+     in the leaf, or a negative value on a miss. _pRays[i].m_fMaxDist is updated with the closest hits and
+     _pBoxHits[i] counts box hits per ray. Packets hold up to 32 rays.
+     */
+    template <typename primitive_type, typename leaf_func>
+    void checkBvhPacketLeafHit(const FlatBvh<primitive_type> &_bvh, CORE::Ray *_pRays, uint32_t _uCount, uint32_t *_pBoxHits, const leaf_func &_leaf)
+    {
+        constexpr int N = CORE::SIMD_WIDTH;
+        struct StackEntry {
+            uint32_t    m_uChild;
+            uint32_t    m_uCount;
+            uint32_t    m_uRays;    // mask of active rays
+            float       m_fEntry;   // nearest entry of active rays
+        };
+        
+        if ( (_bvh.empty() == true) || (_uCount == 0) ) {
+            return;
+        }
+        
+        const auto &bvhNodes = _bvh.wideNodes();
+        CORE::Stack<StackEntry> nodes(64);
+        
+        // start with root (all rays active)
+        nodes.push(StackEntry{0, 0, _uCount >= 32 ? 0xffffffffu : (1u << _uCount) - 1, 0.0f});
+
+        // process nodes
+        while (nodes.empty() == false) {
+            const StackEntry entry = nodes.pop();
+            
+            if (entry.m_uCount > 0) {
+                // leaf (one ray at a time)
+                for (uint32_t rays = entry.m_uRays; rays != 0; rays &= rays - 1) {
+                    const uint32_t r = CORE::lowestBit(rays);
+                    if (float t = _leaf(entry.m_uChild, entry.m_uCount, r, _pRays[r]); (t >= 0) && (t < _pRays[r].m_fMaxDist)) {
+                        _pRays[r].m_fMaxDist = t;
+                    }
+                }
+                
+                continue;
+            }
+            
+            // test all children for every active ray, gathering the rays per child
+            const auto &node = bvhNodes[entry.m_uChild];
+            const uint32_t children = (1u << node.m_uChildren) - 1;
+            std::array<uint32_t, N> childRays = {};
+            std::array<float, N> childEntries;
+            childEntries.fill(std::numeric_limits<float>::max());
+            
+            for (uint32_t rays = entry.m_uRays; rays != 0; rays &= rays - 1) {
+                const uint32_t r = CORE::lowestBit(rays);
+                const auto &ray = _pRays[r];
+                alignas(32) float entries[N];
+                const uint32_t mask = CORE::aaboxIntersect(node.m_bounds, ray.m_origin, ray.m_invDirection, ray.m_fMaxDist, entries) & children;
+                _pBoxHits[r] += CORE::bitCount(mask);
+                
+                for (uint32_t m = mask; m != 0; m &= m - 1) {
+                    const uint32_t i = CORE::lowestBit(m);
+                    childRays[i] |= 1u << r;
+                    childEntries[i] = std::min(childEntries[i], entries[i]);
+                }
+            }
+            
+            // sort hit children far to near (insertion sort), so that the nearest is processed first
+            std::array<StackEntry, N> hits;
+            int count = 0;
+            for (int i = 0; i < N; i++) {
+                if (childRays[i] != 0) {
+                    StackEntry child{node.m_uChild[i], node.m_uCount[i], childRays[i], childEntries[i]};
+                    int j = count++;
+                    for (; (j > 0) && (hits[j-1].m_fEntry < child.m_fEntry); j--) {
+                        hits[j] = hits[j-1];
+                    }
+                    
+                    hits[j] = child;
+                }
+            }
+            
+            for (int i = 0; i < count; i++) {
+                nodes.push(hits[i]);
+            }
+        }
+    }
+
+
 };  // namespace CORE
 
 
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "core/color.h"
+#include "core/random.h"
+#include "core/vec3.h"
+#include "intersect.h"
+#include "material.h"
+#include "primitive.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+namespace BASE
+{
+    /* Point sampled on a light of the scene (world space) */
+    struct LightSample  : public SurfaceSample
+    {
+        CORE::Color                 m_emitted;                  // light emitted towards the sampling position
+        const PrimitiveInstance     *m_pLight = nullptr;        // sampled light
+    };
+
+
+    /*
+     List of the area lights of a scene: instances with an emitting material and a primitive that supports
+     surface sampling. Lights are picked with equal probability.
+     Emitting instances that can't be sampled are not in the list (they are only found by hitting them).
+     */
+    class LightList
+    {
+     public:
+        /* collect lights from scene instances */
+        template <typename instance_container_type>
+        void build(const instance_container_type &_instances) {
+            m_lights.clear();
+
+            SurfaceSample sample;
+            for (const auto &pInstance : _instances) {
+                const Material *pMaterial = pInstance->material();
+                if ( (pMaterial == nullptr) || (pMaterial->emitted(Intersect()).isBlack() == true) ) {
+                    continue;
+                }
+
+                if (pInstance->target()->sampleSurface(sample, CORE::Vec(0, 0, 0)) == true) {
+                    m_lights.push_back(&*pInstance);
+                }
+            }
+
+            std::sort(m_lights.begin(), m_lights.end());
+        }
+
+        /*
+         Samples a point on one of the lights that may be visible from _from.
+         The pdf includes the light selection. Returns false if there are no lights.
+         */
+        bool sample(LightSample &_sample, const CORE::Vec &_from) const {
+            if (m_lights.empty() == true) {
+                return false;
+            }
+
+            std::uniform_int_distribution<size_t> pick(0, m_lights.size() - 1);
+            const PrimitiveInstance *pLight = m_lights[pick(CORE::generator())];
+            if (pLight->sampleSurface(_sample, _from) == false) {
+                return false;
+            }
+
+            // emitted towards _from (lights only emit on the outside)
+            Intersect hit;
+            hit.m_position = _sample.m_position;
+            hit.m_normal = _sample.m_normal;
+            hit.m_bInside = (_from - _sample.m_position) * _sample.m_normal <= 0;
+
+            _sample.m_emitted = pLight->material()->emitted(hit);
+            _sample.m_fPdf /= (float)m_lights.size();
+            _sample.m_pLight = pLight;
+            return true;
+        }
+
+        /*
+         Probability density (per surface area, including the light selection) of sample() returning _position on
+         the light when sampling from _from.
+         */
+        float pdf(const PrimitiveInstance *_pLight, const CORE::Vec &_from, const CORE::Vec &_position) const {
+            if (contains(_pLight) == false) {
+                return 0;
+            }
+
+            return _pLight->surfacePdf(_from, _position) / (float)m_lights.size();
+        }
+
+        /* returns true if the instance is in the light list */
+        bool contains(const PrimitiveInstance *_pInstance) const {
+            return std::binary_search(m_lights.begin(), m_lights.end(), _pInstance);
+        }
+
+        size_t size() const {
+            return m_lights.size();
+        }
+
+     private:
+        std::vector<const PrimitiveInstance*>       m_lights;     // (sorted by address)
+    };
+
+};  // namespace BASE
@@ -5,6 +5,7 @@
 #include "intersect.h"
 #include "resource.h"
 
+#include <algorithm>
 #include <vector>
 #include <memory>
 
@@ -17,6 +18,29 @@ namespace BASE
      public:
         /* Returns the scattered ray at the intersection point. */
         virtual CORE::ScatteredRay &scatter(CORE::ScatteredRay &_sc, const Intersect &_hit) const = 0;
+        
+        /* Returns the light emitted at the intersection point (black for materials that do not emit light). */
+        virtual CORE::Color emitted(const Intersect &) const {
+            return CORE::COLOR::Black;
+        }
+        
+        /*
+         Returns the probability density (per solid angle) of scatter() sampling _direction (unit vector, primitive space)
+         at the intersection point. Materials that scatter in discrete directions (or can't tell) return 0, light
+         sampling is not used on their hits.
+         */
+        virtual float pdf(const Intersect &, const CORE::Vec &) const {
+            return 0;
+        }
+        
+        /*
+         Evaluates the scattering function at the intersection point for light arriving from _direction (unit vector,
+         primitive space): the attenuation of that light, including the cosine term.
+         Consistent with scatter(): the attenuation of scattered rays is eval/pdf of the scattered direction.
+         */
+        virtual CORE::Color eval(const Intersect &, const CORE::Vec &) const {
+            return CORE::COLOR::Black;
+        }
     };
     
     
@@ -42,6 +66,37 @@ namespace BASE
             return _sc;
         }
         
+        /* Probability density of sampling _direction (the materials are expected to have at most one that scatters). */
+        virtual float pdf(const Intersect &_hit, const CORE::Vec &_direction) const override {
+            float ret = 0;
+            for (const auto &pMat : m_materials) {
+                ret = std::max(ret, pMat->pdf(_hit, _direction));
+            }
+            
+            return ret;
+        }
+        
+        /*
+         Evaluates the material that scatters in _direction, attenuated by the other materials (like textures).
+         */
+        virtual CORE::Color eval(const Intersect &_hit, const CORE::Vec &_direction) const override {
+            CORE::Color ret(1, 1, 1);
+            bool bScattered = false;
+            
+            for (const auto &pMat : m_materials) {
+                if (pMat->pdf(_hit, _direction) > 0) {
+                    ret *= pMat->eval(_hit, _direction);
+                    bScattered = true;
+                }
+                else {
+                    CORE::ScatteredRay sc;
+                    ret *= pMat->scatter(sc, _hit).m_color;
+                }
+            }
+            
+            return bScattered ? ret : CORE::COLOR::Black;
+        }
+        
      protected:
         std::vector<std::unique_ptr<Material>>      m_materials;
     };
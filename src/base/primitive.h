@@ -16,6 +16,15 @@
 
 namespace BASE
 {
+    /* Point sampled on the surface of a primitive (used for light sampling) */
+    struct SurfaceSample
+    {
+        CORE::Vec   m_position;         // position on surface
+        CORE::Vec   m_normal;           // (outward) surface normal at position
+        float       m_fPdf = 0;         // probability density of the sample per surface area
+    };
+    
+    
     /*
         Scene Primitive
         API could be accessed by multiple worker threads concurrently.
@@ -32,8 +41,31 @@ namespace BASE
         /* Completes the Intersect properties. */
         virtual Intersect &intersect(Intersect &_hit) const = 0;
         
+        /*
+         Checks for any hit within the ray distance limits (primitive space), for shadow rays.
+         Default uses hit(); shapes with their own acceleration structures stop on the first hit.
+         */
+        virtual bool occluded(const CORE::Ray &_ray) const {
+            Intersect shadow(_ray);
+            shadow.m_priRay = _ray;
+            return hit(shadow);
+        }
+        
         /* returns bounds for shape */
         virtual const CORE::Bounds &bounds() const = 0;
+        
+        /*
+         Samples a point on the surface that may be visible from _from (all in primitive space).
+         Returns false if the shape does not support sampling (can't be used as an area light).
+         */
+        virtual bool sampleSurface(SurfaceSample &, const CORE::Vec &) const {
+            return false;
+        }
+        
+        /* Probability density (per surface area) of sampleSurface() returning _position when sampling from _from. */
+        virtual float surfacePdf(const CORE::Vec &, const CORE::Vec &) const {
+            return 0;
+        }
     };
     
 
@@ -90,6 +122,28 @@ namespace BASE
             return m_pTarget->intersect(_hit);
         }
         
+        /* Checks for any hit within the ray distance limits (view space). */
+        virtual bool occluded(const CORE::Ray &_ray) const {
+            return m_pTarget->occluded(transformRayTo(_ray, m_axis));
+        }
+        
+        /* Samples a point on the surface of the primitive that may be visible from _from (all in world space). */
+        virtual bool sampleSurface(SurfaceSample &_sample, const CORE::Vec &_from) const {
+            if (m_pTarget->sampleSurface(_sample, m_axis.transformTo(_from)) == false) {
+                return false;
+            }
+            
+            _sample.m_position = m_axis.transformFrom(_sample.m_position);
+            _sample.m_normal = m_axis.rotateFrom(_sample.m_normal).normalized();
+            _sample.m_fPdf /= m_axis.m_fScale * m_axis.m_fScale;     // (area scales with the square of the axis scale)
+            return true;
+        }
+        
+        /* Probability density (per surface area) of sampleSurface() returning _position when sampling from _from. */
+        virtual float surfacePdf(const CORE::Vec &_from, const CORE::Vec &_position) const {
+            return m_pTarget->surfacePdf(m_axis.transformTo(_from), m_axis.transformTo(_position)) / (m_axis.m_fScale * m_axis.m_fScale);
+        }
+        
         /* tranform ray back to view space */
         virtual CORE::Ray transformRayFrom(const CORE::Ray &_ray) const {
             return CORE::transformRayFrom(_ray, m_axis);
@@ -112,6 +166,21 @@ namespace BASE
             m_bDirtyBounds = true;
         }
         
+        /* returns the referenced primitive */
+        const Primitive *target() const {
+            return m_pTarget;
+        }
+        
+        /* returns instance transform */
+        const CORE::Axis &axis() const {
+            return m_axis;
+        }
+        
+        /* returns true if instance moved since its bounds were last calculated */
+        bool dirtyBounds() const {
+            return m_bDirtyBounds;
+        }
+        
         /* return axis aligned bounding volume */
         const CORE::Bounds &bounds() const {
             if (m_bDirtyBounds == true) {
@@ -4,6 +4,7 @@
 #include "core/constants.h"
 #include "core/ray.h"
 #include "intersect.h"
+#include "light_list.h"
 #include "material.h"
 #include "primitive.h"
 
@@ -28,9 +29,60 @@ namespace BASE
         virtual bool hit(Intersect &_hit) const = 0;
         
         /*
-            Build scene (BVH, etc.).
+           Checks for intersects of a packet of (coherent) rays with scene objects.
+           Returns a mask of the rays that hit (packets hold up to 32 rays). Default checks one ray at a time.
+           Could be accessed by multiple worker threads concurrently.
+         */
+        virtual uint32_t hitPacket(Intersect *_pHits, uint32_t _uCount) const {
+            uint32_t hits = 0;
+            for (uint32_t i = 0; i < std::min(_uCount, 32u); i++) {
+                hits |= (uint32_t)hit(_pHits[i]) << i;
+            }
+            
+            return hits;
+        }
+        
+        /*
+           Checks for any hit on the ray closer than _fMaxDist (shadow rays). Stops on the first hit and does not
+           complete intersects. Default uses hit().
+           Could be accessed by multiple worker threads concurrently.
+         */
+        virtual bool occluded(const CORE::Ray &_ray, float _fMaxDist) const {
+            Intersect shadow(_ray);
+            shadow.m_viewRay.m_fMaxDist = std::min(_fMaxDist, _ray.m_fMaxDist);
+            return hit(shadow);
+        }
+        
+        /*
+           Samples a point on a light that may be visible from _from (see LightList).
+           Returns false if the scene has no lights that can be sampled (default).
+           Could be accessed by multiple worker threads concurrently.
+         */
+        virtual bool sampleLight(LightSample &, const CORE::Vec &) const {
+            return false;
+        }
+        
+        /*
+           Probability density (per surface area) of sampleLight() returning _position on _pLight when sampling
+           from _from (0 if the instance is not a light that sampleLight picks from).
+           Could be accessed by multiple worker threads concurrently.
+         */
+        virtual float lightPdf(const PrimitiveInstance *, const CORE::Vec &, const CORE::Vec &) const {
+            return 0;
+        }
+        
+        /*
+            Build scene (BVH, light list, etc.).
          */
         virtual void build() = 0;
+        
+        /*
+            Update acceleration structures after primitive instances moved (default is a full build).
+            May not be safe to call while worker threads are calling 'hit'/
+         */
+        virtual void refit() {
+            build();
+        }
 
         /*
          Checks for the background color (miss handler).
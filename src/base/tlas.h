@@ -0,0 +1,179 @@
+#pragma once
+
+#include "core/ray.h"
+#include "core/vec3.h"
+#include "bvh.h"
+#include "intersect.h"
+#include "primitive.h"
+
+#include <algorithm>
+#include <array>
+#include <unordered_set>
+#include <vector>
+
+
+namespace BASE
+{
+    /*
+     Two-level acceleration structure.
+     Primitives (meshes with their own triangle BVHs, analytic shapes, etc.) are the bottom level
+     structures (BLAS) and are shared by all instances that reference them. The top level (TLAS) is a
+     BVH over instance bounds, with instance transforms and target primitives stored contiguously in
+     leaf order, so that traversal transforms the ray once per instance and drops straight into its BLAS.
+     NOTE: instance hits use the instance target and axis directly (PrimitiveInstance::hit is not called).
+     */
+    class Tlas
+    {
+     public:
+        // TLAS instance data (in leaf order)
+        struct Entry
+        {
+            CORE::Axis                  m_axis;
+            const Primitive             *m_pBlas = nullptr;
+            const PrimitiveInstance     *m_pInstance = nullptr;
+        };
+
+     public:
+        constexpr static uint32_t MAX_PACKET_SIZE = 32;     // rays per packet hit test
+        
+     public:
+        Tlas() noexcept = default;
+
+        /* build TLAS over the given instances */
+        void build(const std::vector<const PrimitiveInstance*> &_instances, BVH_SPLIT _split, int _iThreads = 1) {
+            m_instances = _instances;
+            m_bvh.build(m_instances, _split, 1, _iThreads);
+            m_bvh.reorder(m_instances);     // store instances in leaf order
+
+            std::unordered_set<const Primitive*> blas;
+            m_entries.resize(m_instances.size());
+            for (size_t i = 0; i < m_instances.size(); i++) {
+                m_entries[i].m_pBlas = m_instances[i]->target();
+                m_entries[i].m_pInstance = m_instances[i];
+                blas.insert(m_entries[i].m_pBlas);
+            }
+
+            updateTransforms();
+            m_uBlasCount = blas.size();
+        }
+
+        /* refit TLAS to moved instances; returns SAH cost of refitted tree */
+        float refit() {
+            float cost = m_bvh.refit(m_instances, [](const PrimitiveInstance *_pInstance){
+                return _pInstance->dirtyBounds();
+            });
+
+            updateTransforms();
+            return cost;
+        }
+
+        /* Checks for closest hit (could be accessed by multiple worker threads concurrently). */
+        bool hit(Intersect &_hit) const {
+            const Intersect start(_hit);     // every candidate starts from the same state (independent of visiting order)
+            _hit.m_uBoxHits += checkBvhHit(m_bvh, start.m_viewRay,
+                                           [&](uint32_t _uIndex, const CORE::Ray &_ray){
+                                              const auto &entry = m_entries[_uIndex];
+                                              Intersect nh(start);
+                                              nh.m_viewRay.m_fMaxDist = _ray.m_fMaxDist;  // only accept closer hits
+                                              nh.m_priRay = CORE::transformRayTo(nh.m_viewRay, entry.m_axis);
+
+                                              // (primitives may report hits past the limit, e.g. random hits in volumes)
+                                              if ( (entry.m_pBlas->hit(nh) == true) && (nh.m_fPositionOnRay < _ray.m_fMaxDist) ) {
+                                                  nh.m_pPrimitive = entry.m_pInstance;
+                                                  nh.m_viewRay = start.m_viewRay;
+                                                  _hit = nh;
+                                                  return _hit.m_fPositionOnRay;
+                                              }
+
+                                              return -1.0f;
+                                           });
+
+            return _hit;
+        }
+        
+        /* Checks for any hit within the ray distance limits (could be accessed by multiple worker threads concurrently). */
+        bool occluded(const CORE::Ray &_ray) const {
+            return checkBvhAny(m_bvh, _ray, [&](uint32_t _uIndex, const CORE::Ray &_leafRay){
+                const auto &entry = m_entries[_uIndex];
+                return entry.m_pBlas->occluded(CORE::transformRayTo(_leafRay, entry.m_axis));
+            });
+        }
+        
+        /*
+         Checks for closest hits of a packet of rays (up to MAX_PACKET_SIZE), sharing one TLAS traversal.
+         Returns a mask of the rays that hit.
+         */
+        uint32_t hitPacket(Intersect *_pHits, uint32_t _uCount) const {
+            std::array<Intersect, MAX_PACKET_SIZE> starts;
+            std::array<CORE::Ray, MAX_PACKET_SIZE> rays;
+            std::array<uint32_t, MAX_PACKET_SIZE> boxHits = {};
+            uint32_t hits = 0;
+            
+            _uCount = std::min(_uCount, MAX_PACKET_SIZE);
+            for (uint32_t i = 0; i < _uCount; i++) {
+                starts[i] = _pHits[i];
+                rays[i] = _pHits[i].m_viewRay;
+            }
+            
+            checkBvhPacketLeafHit(m_bvh, rays.data(), _uCount, boxHits.data(),
+                                  [&](uint32_t _uFirst, uint32_t _uLeafCount, uint32_t _uRay, const CORE::Ray &_ray){
+                                      const auto &start = starts[_uRay];
+                                      float closest = -1.0f;
+                                      CORE::Ray ray(_ray);
+                                      
+                                      for (uint32_t i = _uFirst; i < _uFirst + _uLeafCount; i++) {
+                                          const auto &entry = m_entries[m_bvh.indices()[i]];
+                                          Intersect nh(start);
+                                          nh.m_viewRay.m_fMaxDist = ray.m_fMaxDist;   // only accept closer hits
+                                          nh.m_priRay = CORE::transformRayTo(nh.m_viewRay, entry.m_axis);
+                                          
+                                          if ( (entry.m_pBlas->hit(nh) == true) && (nh.m_fPositionOnRay < ray.m_fMaxDist) ) {
+                                              nh.m_pPrimitive = entry.m_pInstance;
+                                              nh.m_viewRay = start.m_viewRay;
+                                              _pHits[_uRay] = nh;
+                                              ray.m_fMaxDist = closest = nh.m_fPositionOnRay;
+                                              hits |= 1u << _uRay;
+                                          }
+                                      }
+                                      
+                                      return closest;
+                                  });
+            
+            for (uint32_t i = 0; i < _uCount; i++) {
+                _pHits[i].m_uBoxHits += boxHits[i];
+            }
+            
+            return hits;
+        }
+
+        /* number of instances */
+        size_t size() const {
+            return m_entries.size();
+        }
+
+        /* number of unique bottom level structures (primitives) */
+        size_t blasCount() const {
+            return m_uBlasCount;
+        }
+
+        const BvhBuildStats &stats() const {
+            return m_bvh.stats();
+        }
+
+     private:
+        // copy instance transforms into leaf ordered entries
+        void updateTransforms() {
+            for (size_t i = 0; i < m_instances.size(); i++) {
+                m_entries[i].m_axis = m_instances[i]->axis();
+            }
+        }
+
+     private:
+        std::vector<const PrimitiveInstance*>   m_instances;      // in leaf order
+        std::vector<Entry>                      m_entries;        // in leaf order
+        FlatBvh<PrimitiveInstance>              m_bvh;
+        size_t                                  m_uBlasCount = 0;
+    };
+
+
+};  // namespace BASE
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "constants.h"
+#include "color.h"
+#include "outputimage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+
+namespace CORE
+{
+    /*
+     Float RGB accumulation buffer for progressive rendering.
+     Holds color sums and sample counts per pixel, in two halves (samples of even and odd passes), so that the
+     noise of the image can be estimated from the difference of the halves.
+     Rows are added and the image is resolved under a lock (jobs add rows while the image is displayed).
+     */
+    class AccumulationBuffer
+    {
+     public:
+        AccumulationBuffer(int _iWidth, int _iHeight)
+            :m_iWidth(_iWidth),
+             m_iHeight(_iHeight),
+             m_pixels((size_t)_iWidth * _iHeight)
+        {}
+
+        int width() const {return m_iWidth;}
+        int height() const {return m_iHeight;}
+
+        /*
+         Add color sums and sample counts of a rectangle (rows of _iWidth values in _pSums and _pCounts),
+         _iHalf selects the half buffer (0 or 1).
+         */
+        void addRect(int _iX, int _iY, int _iWidth, int _iHeight, int _iHalf, const Color *_pSums, const int *_pCounts) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (int j = 0; j < _iHeight; j++) {
+                Pixel *pPixel = m_pixels.data() + (size_t)m_iWidth * (_iY + j) + _iX;
+                for (int i = 0; i < _iWidth; i++) {
+                    pPixel[i].m_sum[_iHalf] += *_pSums++;
+                    pPixel[i].m_fCount[_iHalf] += (float)*_pCounts++;
+                }
+            }
+        }
+
+        /* resolve averaged colors (clamped, gamma 2) into the output image */
+        void resolve(OutputImageBuffer &_image) const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (int y = 0; y < m_iHeight; y++) {
+                unsigned char *pOut = _image.row(y);
+                const Pixel *pPixel = m_pixels.data() + (size_t)m_iWidth * y;
+                for (int i = 0; i < m_iWidth; i++) {
+                    const auto color = pPixel[i].mean().clamp().gammaCorrect2();
+                    *(pOut++) = (unsigned char)(255 * color.red() + 0.5f);
+                    *(pOut++) = (unsigned char)(255 * color.green() + 0.5f);
+                    *(pOut++) = (unsigned char)(255 * color.blue() + 0.5f);
+                }
+            }
+        }
+
+        /*
+         Estimated noise of the resolved image: RMS over pixels of the standard error of the pixel luminance,
+         in display units (clamped, gamma 2, range 0..1). The error of a pixel is half the difference of the
+         means of its two halves. Returns a negative value until pixels have samples in both halves.
+         */
+        float noiseEstimate() const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            double sum = 0;
+            size_t count = 0;
+            for (const auto &pixel : m_pixels) {
+                if ( (pixel.m_fCount[0] > 0) && (pixel.m_fCount[1] > 0) ) {
+                    const float a = sqrtf(clamp((pixel.m_sum[0] / pixel.m_fCount[0]).luminance(), 0.0f, 1.0f));
+                    const float b = sqrtf(clamp((pixel.m_sum[1] / pixel.m_fCount[1]).luminance(), 0.0f, 1.0f));
+                    sum += 0.25 * (a - b) * (a - b);
+                    count++;
+                }
+            }
+
+            return count > 0 ? (float)std::sqrt(sum / count) : -1.0f;
+        }
+
+     private:
+        struct Pixel
+        {
+            Color   m_sum[2];
+            float   m_fCount[2] = {};
+
+            Color mean() const {
+                const float count = m_fCount[0] + m_fCount[1];
+                return count > 0 ? (m_sum[0] + m_sum[1]) / count : Color(0, 0, 0);
+            }
+        };
+
+        int                         m_iWidth;
+        int                         m_iHeight;
+        std::vector<Pixel>          m_pixels;
+        mutable std::mutex          m_mutex;
+    };
+
+};  // namespace CORE
@@ -124,6 +124,11 @@ namespace CORE
             return m_c[0] + m_c[1] + m_c[2] < 0.0001f;
         }
         
+        // relative luminance (Rec. 709 weights)
+        float luminance() const {
+            return 0.2126f * m_c[0] + 0.7152f * m_c[1] + 0.0722f * m_c[2];
+        }
+        
         float max() const {
             return std::max(m_c[0], std::max(m_c[1], m_c[2]));
         }
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace CORE
+{
+    constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+    constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+
+    // 64-bit FNV-1a hash of raw bytes (pass a previous hash as seed to hash multiple blocks)
+    inline uint64_t hashBytes(const void *_pData, size_t _uSize, uint64_t _uSeed = FNV_OFFSET_BASIS) {
+        auto pBytes = static_cast<const uint8_t*>(_pData);
+        uint64_t hash = _uSeed;
+        for (size_t i = 0; i < _uSize; i++) {
+            hash = (hash ^ pBytes[i]) * FNV_PRIME;
+        }
+
+        return hash;
+    }
+
+
+    // hash a plain value (trivially copyable) into a previous hash
+    template <typename T>
+    uint64_t hashValue(const T &_value, uint64_t _uSeed = FNV_OFFSET_BASIS) {
+        return hashBytes(&_value, sizeof(T), _uSeed);
+    }
+
+};  // namespace CORE
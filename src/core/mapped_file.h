@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <fstream>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+namespace CORE
+{
+    /*
+     Read-only memory mapped file.
+     Falls back to reading the whole file into memory where mmap is not available.
+     */
+    class MappedFile
+    {
+     public:
+        MappedFile() = default;
+        
+        MappedFile(const std::string &_strPath) {
+            open(_strPath);
+        }
+        
+        ~MappedFile() {
+            close();
+        }
+        
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        
+        /* map file; returns false if file could not be opened */
+        bool open(const std::string &_strPath) {
+            close();
+            
+#if defined(_WIN32)
+            std::ifstream file(_strPath, std::ios::binary | std::ios::ate);
+            if (file.is_open() == false) {
+                return false;
+            }
+            
+            m_buffer.resize((size_t)file.tellg());
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(m_buffer.data()), m_buffer.size());
+            m_pData = m_buffer.data();
+            m_uSize = m_buffer.size();
+#else
+            int fd = ::open(_strPath.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            
+            struct stat st = {};
+            if ( (fstat(fd, &st) == 0) && (st.st_size > 0) ) {
+                void *pData = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (pData != MAP_FAILED) {
+                    m_pData = static_cast<const uint8_t*>(pData);
+                    m_uSize = (size_t)st.st_size;
+                }
+            }
+            
+            ::close(fd);
+#endif
+            return m_pData != nullptr;
+        }
+        
+        void close() {
+#if defined(_WIN32)
+            m_buffer.clear();
+#else
+            if (m_pData != nullptr) {
+                munmap(const_cast<uint8_t*>(m_pData), m_uSize);
+            }
+#endif
+            m_pData = nullptr;
+            m_uSize = 0;
+        }
+        
+        bool isOpen() const {
+            return m_pData != nullptr;
+        }
+        
+        const uint8_t *data() const {
+            return m_pData;
+        }
+        
+        size_t size() const {
+            return m_uSize;
+        }
+        
+     private:
+        const uint8_t           *m_pData = nullptr;
+        size_t                  m_uSize = 0;
+#if defined(_WIN32)
+        std::vector<uint8_t>    m_buffer;
+#endif
+    };
+
+};  // namespace CORE
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "constants.h"
+#include "vec3.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+
+namespace CORE
+{
+    // index of highest set bit (value has to be non-zero)
+    inline int highestBit(uint64_t _v) {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanReverse64(&index, _v);
+        return (int)index;
+#else
+        return 63 - __builtin_clzll(_v);
+#endif
+    }
+
+
+    // index of lowest set bit (value has to be non-zero)
+    inline uint32_t lowestBit(uint32_t _v) {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward(&index, _v);
+        return (uint32_t)index;
+#else
+        return (uint32_t)__builtin_ctz(_v);
+#endif
+    }
+
+
+    // number of set bits
+    inline uint32_t bitCount(uint32_t _v) {
+        return (uint32_t)std::bitset<32>(_v).count();
+    }
+
+
+    // spread lower 21 bits of value out to every third bit
+    inline uint64_t expandBits21(uint64_t _v) {
+        _v &= 0x1fffff;
+        _v = (_v | (_v << 32)) & 0x001f00000000ffffull;
+        _v = (_v | (_v << 16)) & 0x001f0000ff0000ffull;
+        _v = (_v | (_v << 8))  & 0x100f00f00f00f00full;
+        _v = (_v | (_v << 4))  & 0x10c30c30c30c30c3ull;
+        _v = (_v | (_v << 2))  & 0x1249249249249249ull;
+        return _v;
+    }
+
+
+    // 63-bit morton code (21 bits per axis)
+    inline uint64_t mortonCode(uint32_t _x, uint32_t _y, uint32_t _z) {
+        return (expandBits21(_x) << 2) | (expandBits21(_y) << 1) | expandBits21(_z);
+    }
+
+
+    // spread lower 32 bits of value out to every second bit
+    inline uint64_t expandBits32(uint64_t _v) {
+        _v &= 0xffffffff;
+        _v = (_v | (_v << 16)) & 0x0000ffff0000ffffull;
+        _v = (_v | (_v << 8))  & 0x00ff00ff00ff00ffull;
+        _v = (_v | (_v << 4))  & 0x0f0f0f0f0f0f0f0full;
+        _v = (_v | (_v << 2))  & 0x3333333333333333ull;
+        _v = (_v | (_v << 1))  & 0x5555555555555555ull;
+        return _v;
+    }
+
+
+    // 64-bit 2D morton code (32 bits per axis)
+    inline uint64_t mortonCode(uint32_t _x, uint32_t _y) {
+        return (expandBits32(_y) << 1) | expandBits32(_x);
+    }
+
+
+    // index of a cell on the Hilbert curve through a grid of 2^_uOrder x 2^_uOrder cells
+    inline uint64_t hilbertIndex(uint32_t _uOrder, uint32_t _x, uint32_t _y) {
+        const uint32_t side = 1u << _uOrder;
+        uint64_t d = 0;
+        for (uint32_t s = side >> 1; s > 0; s >>= 1) {
+            const uint32_t rx = (_x & s) > 0 ? 1 : 0;
+            const uint32_t ry = (_y & s) > 0 ? 1 : 0;
+            d += (uint64_t)s * s * ((3 * rx) ^ ry);
+            
+            // rotate quadrant, so that the curve continues in the lower bits
+            if (ry == 0) {
+                if (rx == 1) {
+                    _x = side - 1 - _x;
+                    _y = side - 1 - _y;
+                }
+                
+                std::swap(_x, _y);
+            }
+        }
+        
+        return d;
+    }
+
+
+    // 63-bit morton code for a position inside the given bounds
+    inline uint64_t mortonCode(const Vec &_pos, const Bounds &_bounds) {
+        constexpr float SCALE = (float)((1 << 21) - 1);
+        std::array<uint32_t, 3> q = {};
+        for (int i = 0; i < 3; i++) {
+            const float extent = _bounds.m_max.m_v[i] - _bounds.m_min.m_v[i];
+            if (extent > 0) {
+                float f = clamp((_pos.m_v[i] - _bounds.m_min.m_v[i]) / extent, 0.0f, 1.0f);
+                q[i] = (uint32_t)(f * SCALE);
+            }
+        }
+
+        return mortonCode(q[0], q[1], q[2]);
+    }
+
+
+    /*
+     Sorts (key, value) items on key (stable LSD radix sort, 8 bits per pass).
+     Each pass builds per-chunk histograms and scatters the chunks on _iThreads threads.
+     Passes where all keys share the same digit are skipped.
+     */
+    template <typename value_type>
+    void radixSort(std::vector<std::pair<uint64_t, value_type>> &_items, int _iThreads = 1) {
+        using Histogram = std::array<size_t, 256>;
+        constexpr size_t MIN_CHUNK_SIZE = 16384;
+
+        const size_t n = _items.size();
+        std::vector<std::pair<uint64_t, value_type>> buffer(n);
+        std::vector<Histogram> histograms(std::max(_iThreads, 1));
+
+        // chunks are the same for every call (same count, threads and chunk size)
+        auto forChunks = [&](const auto &_func) {
+            parallelFor(n, _iThreads, MIN_CHUNK_SIZE, _func);
+        };
+
+        for (int shift = 0; shift < 64; shift += 8) {
+            for (auto &histogram : histograms) {
+                histogram.fill(0);      // (there may be fewer chunks than threads)
+            }
+            
+            forChunks([&](size_t _uChunk, size_t _uBegin, size_t _uEnd) {
+                auto &histogram = histograms[_uChunk];
+                for (size_t i = _uBegin; i < _uEnd; i++) {
+                    histogram[(_items[i].first >> shift) & 0xff]++;
+                }
+            });
+
+            // exclusive prefix sum over (digit, chunk) gives scatter offsets
+            size_t sum = 0;
+            bool skip = false;
+            for (size_t d = 0; d < 256; d++) {
+                size_t count = 0;
+                for (size_t c = 0; c < histograms.size(); c++) {
+                    size_t v = histograms[c][d];
+                    histograms[c][d] = sum;
+                    sum += v;
+                    count += v;
+                }
+
+                if (count == n) {
+                    skip = true;    // all keys have the same digit
+                    break;
+                }
+            }
+
+            if (skip == true) {
+                continue;
+            }
+
+            forChunks([&](size_t _uChunk, size_t _uBegin, size_t _uEnd) {
+                auto &offsets = histograms[_uChunk];
+                for (size_t i = _uBegin; i < _uEnd; i++) {
+                    buffer[offsets[(_items[i].first >> shift) & 0xff]++] = _items[i];
+                }
+            });
+
+            _items.swap(buffer);
+        }
+    }
+
+};  // namespace CORE
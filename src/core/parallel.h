@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <thread>
+#include <vector>
+
+
+namespace CORE
+{
+    /*
+     Splits [0, _uCount) into (at most _iThreads) chunks of at least _uMinChunkSize items and calls
+     _func(chunk, begin, end) for each chunk. The first chunk runs on the calling thread, the rest on
+     separate tasks. Returns after all chunks are done.
+     Intended for data-parallel preprocessing (scene loading, builds) outside of the render workers.
+     */
+    template <typename func_type>
+    void parallelFor(size_t _uCount, int _iThreads, size_t _uMinChunkSize, const func_type &_func) {
+        const size_t chunks = std::max<size_t>(1, std::min<size_t>(std::max(_iThreads, 1), _uCount / std::max<size_t>(_uMinChunkSize, 1)));
+        const size_t chunkSize = (_uCount + chunks - 1) / chunks;
+
+        std::vector<std::future<void>> tasks;
+        for (size_t c = 1; c < chunks; c++) {
+            tasks.push_back(std::async(std::launch::async, [&, c](){
+                _func(c, c * chunkSize, std::min(_uCount, (c + 1) * chunkSize));
+            }));
+        }
+
+        _func(0, 0, std::min(_uCount, chunkSize));
+        for (auto &task : tasks) {
+            task.get();
+        }
+    }
+
+
+    // number of threads to use for parallel preprocessing
+    inline int hardwareThreads() {
+        return std::max(1, (int)std::thread::hardware_concurrency());
+    }
+
+};  // namespace CORE
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "constants.h"
+#include "vec3.h"
+#include "uv.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+
+namespace CORE
+{
+    // float to IEEE half float (round to nearest even, overflow to infinity)
+    inline uint16_t floatToHalf(float _f) {
+        uint32_t x = 0;
+        std::memcpy(&x, &_f, sizeof(x));
+
+        const uint32_t sign = (x >> 16) & 0x8000;
+        const int exp = (int)((x >> 23) & 0xff);
+        uint32_t mantissa = x & 0x7fffff;
+
+        if (exp == 0xff) {
+            return (uint16_t)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));    // infinity, nan
+        }
+
+        const int e = exp - 127 + 15;
+        if (e >= 31) {
+            return (uint16_t)(sign | 0x7c00);
+        }
+
+        if (e <= 0) {
+            // subnormal (or zero)
+            if (e < -10) {
+                return (uint16_t)sign;
+            }
+
+            mantissa |= 0x800000;
+            const uint32_t shift = (uint32_t)(14 - e);
+            const uint32_t rest = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            uint32_t h = mantissa >> shift;
+            if ( (rest > halfway) || ((rest == halfway) && (h & 1)) ) {
+                h++;
+            }
+
+            return (uint16_t)(sign | h);
+        }
+
+        uint32_t h = ((uint32_t)e << 10) | (mantissa >> 13);
+        const uint32_t rest = mantissa & 0x1fff;
+        if ( (rest > 0x1000) || ((rest == 0x1000) && (h & 1)) ) {
+            h++;    // (carry into exponent is correct, up to infinity)
+        }
+
+        return (uint16_t)(sign | h);
+    }
+
+
+    // IEEE half float to float
+    inline float halfToFloat(uint16_t _h) {
+        const uint32_t sign = ((uint32_t)_h & 0x8000) << 16;
+        const uint32_t exp = ((uint32_t)_h >> 10) & 0x1f;
+        const uint32_t mantissa = (uint32_t)_h & 0x3ff;
+
+        if (exp == 0) {
+            const float f = (float)mantissa * (1.0f / 16777216.0f);     // subnormal: mantissa * 2^-24
+            return sign != 0 ? -f : f;
+        }
+
+        const uint32_t x = sign | (exp == 31 ? 0x7f800000 | (mantissa << 13) : ((exp + 112) << 23) | (mantissa << 13));
+        float f = 0;
+        std::memcpy(&f, &x, sizeof(f));
+        return f;
+    }
+
+
+    // uv as two half floats
+    inline uint32_t packHalfUv(const Uv &_uv) {
+        return (uint32_t)floatToHalf(_uv.u()) | ((uint32_t)floatToHalf(_uv.v()) << 16);
+    }
+
+
+    inline Uv unpackHalfUv(uint32_t _uPacked) {
+        return Uv(halfToFloat((uint16_t)(_uPacked & 0xffff)), halfToFloat((uint16_t)(_uPacked >> 16)));
+    }
+
+
+    /*
+     Unit vector in octahedral encoding (2 x 16 bit snorm).
+     The sphere is projected on the octahedron |x| + |y| + |z| = 1, with the lower half folded over the upper half.
+     */
+    inline uint32_t octEncode(const Vec &_normal) {
+        auto sign = [](float _f) {return _f >= 0 ? 1.0f : -1.0f;};
+        auto snorm16 = [](float _f) {return (uint32_t)(uint16_t)(int16_t)std::lround(clamp(_f, -1.0f, 1.0f) * 32767.0f);};
+
+        const float l1 = std::fabs(_normal.x()) + std::fabs(_normal.y()) + std::fabs(_normal.z());
+        if (l1 <= 0) {
+            return 0;
+        }
+
+        float x = _normal.x() / l1;
+        float y = _normal.y() / l1;
+        if (_normal.z() < 0) {
+            const float fx = x;
+            x = (1 - std::fabs(y)) * sign(fx);
+            y = (1 - std::fabs(fx)) * sign(y);
+        }
+
+        return snorm16(x) | (snorm16(y) << 16);
+    }
+
+
+    inline Vec octDecode(uint32_t _uPacked) {
+        const float x = std::max((int16_t)(_uPacked & 0xffff) / 32767.0f, -1.0f);
+        const float y = std::max((int16_t)(_uPacked >> 16) / 32767.0f, -1.0f);
+
+        Vec n(x, y, 1 - std::fabs(x) - std::fabs(y));
+        const float t = std::max(-n.z(), 0.0f);
+        n.m_v[0] += n.x() >= 0 ? -t : t;
+        n.m_v[1] += n.y() >= 0 ? -t : t;
+        return n.normalized();
+    }
+
+};  // namespace CORE
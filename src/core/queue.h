@@ -4,10 +4,16 @@
 #include "constants.h"
 #include "random.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <queue>
 #include <condition_variable>
+#include <type_traits>
+#include <vector>
 
 
 namespace CORE
@@ -38,7 +44,7 @@ namespace CORE
         template <typename T>
         void push(T &&_item) {
             std::lock_guard<std::mutex> lock(m_mutex);
-            m_queue.push(std::forward(_item));
+            m_queue.push(std::forward<T>(_item));
             m_iSize = (int)m_queue.size();
         }
         
@@ -238,13 +244,150 @@ namespace CORE
     };
 
 
+    /*
+        Work-stealing deque (Chase-Lev, with the C11 memory orderings of Le et al. 2013).
+        The owner thread pushes and pops at the bottom (LIFO), any thread can steal from the top (FIFO).
+        Lock free; the array grows when full (owner only), replaced arrays are kept until destruction since
+        stealers may still read from them. Items have to be trivially copyable (e.g. pointers).
+     */
+    template <typename item_type>
+    class StealingDeque
+    {
+     static_assert(std::is_trivially_copyable<item_type>::value, "Deque items should be trivially copyable.");
+     private:
+        class Array
+        {
+         public:
+            Array(size_t _uCapacity)
+                :m_uMask(_uCapacity - 1),
+                 m_items(_uCapacity)
+            {}
+            
+            size_t capacity() const {
+                return m_uMask + 1;
+            }
+            
+            item_type get(int64_t _iIndex) const {
+                return m_items[(size_t)_iIndex & m_uMask].load(std::memory_order_relaxed);
+            }
+            
+            void put(int64_t _iIndex, item_type _item) {
+                m_items[(size_t)_iIndex & m_uMask].store(_item, std::memory_order_relaxed);
+            }
+            
+         private:
+            size_t                                  m_uMask;
+            std::vector<std::atomic<item_type>>     m_items;
+        };
+        
+     public:
+        StealingDeque(size_t _uCapacity = 64)
+            :m_iTop(0),
+             m_iBottom(0)
+        {
+            m_arrays.push_back(std::make_unique<Array>(std::max(roundUpPowerOf2(_uCapacity), (size_t)2)));
+            m_pArray = m_arrays.back().get();
+        }
+        
+        // owner only
+        void push(item_type _item) {
+            const int64_t b = m_iBottom.load(std::memory_order_relaxed);
+            const int64_t t = m_iTop.load(std::memory_order_acquire);
+            Array *pArray = m_pArray.load(std::memory_order_relaxed);
+            if (b - t >= (int64_t)pArray->capacity()) {
+                pArray = grow(pArray, t, b);
+            }
+            
+            pArray->put(b, _item);
+            m_iBottom.store(b + 1, std::memory_order_release);
+        }
+        
+        // owner only, returns false if empty
+        bool pop(item_type &_item) {
+            const int64_t b = m_iBottom.load(std::memory_order_relaxed) - 1;
+            Array *pArray = m_pArray.load(std::memory_order_relaxed);
+            m_iBottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = m_iTop.load(std::memory_order_relaxed);
+            
+            if (t > b) {
+                m_iBottom.store(b + 1, std::memory_order_relaxed);      // (empty)
+                return false;
+            }
+            
+            _item = pArray->get(b);
+            if (t == b) {
+                // last item, race against stealers
+                const bool bWon = m_iTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                m_iBottom.store(b + 1, std::memory_order_relaxed);
+                return bWon;
+            }
+            
+            return true;
+        }
+        
+        // any thread, returns false if empty or if another thread took the item first
+        bool steal(item_type &_item) {
+            int64_t t = m_iTop.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = m_iBottom.load(std::memory_order_acquire);
+            
+            if (t >= b) {
+                return false;
+            }
+            
+            _item = m_pArray.load(std::memory_order_acquire)->get(t);
+            return m_iTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+        
+        // number of items (approximate while other threads push or steal)
+        size_t size() const {
+            const int64_t b = m_iBottom.load(std::memory_order_relaxed);
+            const int64_t t = m_iTop.load(std::memory_order_relaxed);
+            return b > t ? (size_t)(b - t) : 0;
+        }
+        
+        bool empty() const {
+            return size() == 0;
+        }
+        
+     private:
+        // double the array (owner only)
+        Array *grow(Array *_pArray, int64_t _iTop, int64_t _iBottom) {
+            m_arrays.push_back(std::make_unique<Array>(_pArray->capacity() * 2));
+            Array *pArray = m_arrays.back().get();
+            for (int64_t i = _iTop; i < _iBottom; i++) {
+                pArray->put(i, _pArray->get(i));
+            }
+            
+            m_pArray.store(pArray, std::memory_order_release);
+            return pArray;
+        }
+        
+        static size_t roundUpPowerOf2(size_t _uValue) {
+            size_t ret = 1;
+            while (ret < _uValue) {
+                ret <<= 1;
+            }
+            
+            return ret;
+        }
+        
+     private:
+        std::atomic<int64_t>                    m_iTop;
+        std::atomic<int64_t>                    m_iBottom;
+        std::atomic<Array*>                     m_pArray;
+        std::vector<std::unique_ptr<Array>>     m_arrays;       // (current array last, owner only)
+    };
+
+
     /* Quick LIFO container */
     template <typename item_type>
     class Stack
     {
      public:
         Stack(size_t _uReservedSize = 16) noexcept
-            :m_items(_uReservedSize, {}),
+            :m_items(_uReservedSize),
              m_uSize(0)
         {}
         
@@ -98,15 +98,21 @@ namespace CORE
     }
 
 
-    /* transform ray to space */
+    /* transform ray to space (positions on ray are not affected by the transform, so min/max distances are kept) */
     inline Ray transformRayTo(const Ray &_ray, const Axis &_axis) {
-        return Ray(_axis.transformTo(_ray.m_origin), _axis.rotateTo(_ray.m_direction), _ray.m_bPrimary);
+        Ray ray(_axis.transformTo(_ray.m_origin), _axis.rotateTo(_ray.m_direction), _ray.m_bPrimary);
+        ray.m_fMinDist = _ray.m_fMinDist;
+        ray.m_fMaxDist = _ray.m_fMaxDist;
+        return ray;
     }
 
 
-    /* transform ray from space */
+    /* transform ray from space (positions on ray are not affected by the transform, so min/max distances are kept) */
     inline Ray transformRayFrom(const Ray &_ray, const Axis &_axis) {
-        return Ray(_axis.transformFrom(_ray.m_origin), _axis.rotateFrom(_ray.m_direction), _ray.m_bPrimary);
+        Ray ray(_axis.transformFrom(_ray.m_origin), _axis.rotateFrom(_ray.m_direction), _ray.m_bPrimary);
+        ray.m_fMinDist = _ray.m_fMinDist;
+        ray.m_fMaxDist = _ray.m_fMaxDist;
+        return ray;
     }
 
 
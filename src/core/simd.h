@@ -0,0 +1,271 @@
+#pragma once
+
+#include "constants.h"
+#include "vec3.h"
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <immintrin.h>
+    #define USE_SSE     1
+#endif
+
+#if defined(__AVX__)
+    #define USE_AVX     1
+#endif
+
+
+namespace CORE
+{
+    // number of boxes tested together by wide BVH nodes
+#if defined(USE_AVX)
+    constexpr int SIMD_WIDTH = 8;
+#else
+    constexpr int SIMD_WIDTH = 4;
+#endif
+
+
+    /*
+     N axis aligned boxes stored as structure-of-arrays (for SIMD slab tests).
+     */
+    template <int N>
+    struct alignas(32) BoundsN
+    {
+        void set(int _iIndex, const Bounds &_bounds) {
+            for (int i = 0; i < 3; i++) {
+                m_min[i][_iIndex] = _bounds.m_min.m_v[i];
+                m_max[i][_iIndex] = _bounds.m_max.m_v[i];
+            }
+        }
+
+        float   m_min[3][N] = {};
+        float   m_max[3][N] = {};
+    };
+
+
+    /*
+     Ray-box intersection for N boxes at once (_invDir = 1 / ray_direction).
+     Returns a bit mask of boxes that are hit between 0 and _fMaxDist, with entry positions in _pEntry.
+     Scalar version (used where no SIMD version is available).
+     */
+    template <int N>
+    inline uint32_t aaboxIntersect(const BoundsN<N> &_boxes, const Vec &_origin, const Vec &_invDir, float _fMaxDist, float *_pEntry) {
+        uint32_t mask = 0;
+        for (int j = 0; j < N; j++) {
+            float tmin = 0;
+            float tmax = _fMaxDist;
+
+            for (int i = 0; i < 3; i++) {
+                const float t1 = (_boxes.m_min[i][j] - _origin.m_v[i]) * _invDir.m_v[i];
+                const float t2 = (_boxes.m_max[i][j] - _origin.m_v[i]) * _invDir.m_v[i];
+                tmin = maxf(tmin, minf(t1, t2));
+                tmax = minf(tmax, maxf(t1, t2));
+            }
+
+            _pEntry[j] = tmin;
+            mask |= (uint32_t)(tmin <= tmax) << j;
+        }
+
+        return mask;
+    }
+
+
+#if defined(USE_SSE)
+    // ray-box intersection for 4 boxes (SSE)
+    template <>
+    inline uint32_t aaboxIntersect<4>(const BoundsN<4> &_boxes, const Vec &_origin, const Vec &_invDir, float _fMaxDist, float *_pEntry) {
+        __m128 tmin = _mm_setzero_ps();
+        __m128 tmax = _mm_set1_ps(_fMaxDist);
+
+        for (int i = 0; i < 3; i++) {
+            const __m128 origin = _mm_set1_ps(_origin.m_v[i]);
+            const __m128 invDir = _mm_set1_ps(_invDir.m_v[i]);
+            const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(_boxes.m_min[i]), origin), invDir);
+            const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(_boxes.m_max[i]), origin), invDir);
+            tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+            tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+        }
+
+        _mm_storeu_ps(_pEntry, tmin);
+        return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+    }
+#endif
+
+
+#if defined(USE_AVX)
+    // ray-box intersection for 8 boxes (AVX)
+    template <>
+    inline uint32_t aaboxIntersect<8>(const BoundsN<8> &_boxes, const Vec &_origin, const Vec &_invDir, float _fMaxDist, float *_pEntry) {
+        __m256 tmin = _mm256_setzero_ps();
+        __m256 tmax = _mm256_set1_ps(_fMaxDist);
+
+        for (int i = 0; i < 3; i++) {
+            const __m256 origin = _mm256_set1_ps(_origin.m_v[i]);
+            const __m256 invDir = _mm256_set1_ps(_invDir.m_v[i]);
+            const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(_boxes.m_min[i]), origin), invDir);
+            const __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(_boxes.m_max[i]), origin), invDir);
+            tmin = _mm256_max_ps(tmin, _mm256_min_ps(t1, t2));
+            tmax = _mm256_min_ps(tmax, _mm256_max_ps(t1, t2));
+        }
+
+        _mm256_storeu_ps(_pEntry, tmin);
+        return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ));
+    }
+#endif
+
+
+
+    /*
+     N triangles stored as structure-of-arrays (first vertex and the two edges from it), for SIMD
+     ray-triangle tests.
+     */
+    template <int N>
+    struct alignas(32) TrianglesN
+    {
+        void set(int _iIndex, const Vec &_v0, const Vec &_v1, const Vec &_v2) {
+            for (int i = 0; i < 3; i++) {
+                m_v0[i][_iIndex] = _v0.m_v[i];
+                m_e1[i][_iIndex] = _v1.m_v[i] - _v0.m_v[i];
+                m_e2[i][_iIndex] = _v2.m_v[i] - _v0.m_v[i];
+            }
+        }
+
+        float   m_v0[3][N] = {};
+        float   m_e1[3][N] = {};
+        float   m_e2[3][N] = {};
+    };
+
+
+    /*
+     Ray-triangle intersection (Moller-Trumbore) for N triangles at once.
+     Returns a bit mask of triangles hit between _fMinDist and _fMaxDist, with positions on the ray
+     in _pT and barycentric coordinates in _pU, _pV.
+     Scalar version (used where no SIMD version is available).
+     */
+    template <int N>
+    inline uint32_t triangleIntersect(const TrianglesN<N> &_triangles, const Vec &_origin, const Vec &_direction,
+                                      float _fMinDist, float _fMaxDist, float *_pT, float *_pU, float *_pV)
+    {
+        constexpr float EPSILON = 0.000001f;
+        uint32_t mask = 0;
+        for (int j = 0; j < N; j++) {
+            const Vec v0(_triangles.m_v0[0][j], _triangles.m_v0[1][j], _triangles.m_v0[2][j]);
+            const Vec edge1(_triangles.m_e1[0][j], _triangles.m_e1[1][j], _triangles.m_e1[2][j]);
+            const Vec edge2(_triangles.m_e2[0][j], _triangles.m_e2[1][j], _triangles.m_e2[2][j]);
+
+            const Vec h = crossProduct(_direction, edge2);
+            const float a = edge1 * h;
+            if (fabs(a) < EPSILON) {
+                continue;
+            }
+
+            const float f = 1.0f / a;
+            const Vec s = _origin - v0;
+            const float u = f * (s * h);
+            const Vec q = crossProduct(s, edge1);
+            const float v = f * (_direction * q);
+            const float t = f * (edge2 * q);
+
+            _pT[j] = t;
+            _pU[j] = u;
+            _pV[j] = v;
+            mask |= (uint32_t)((u >= 0) && (u <= 1) && (v >= 0) && (u + v <= 1) && (t >= _fMinDist) && (t <= _fMaxDist)) << j;
+        }
+
+        return mask;
+    }
+
+
+#if defined(USE_SSE)
+    // ray-triangle intersection for 4 triangles (SSE)
+    template <>
+    inline uint32_t triangleIntersect<4>(const TrianglesN<4> &_triangles, const Vec &_origin, const Vec &_direction,
+                                         float _fMinDist, float _fMaxDist, float *_pT, float *_pU, float *_pV)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 dx = _mm_set1_ps(_direction.m_v[0]), dy = _mm_set1_ps(_direction.m_v[1]), dz = _mm_set1_ps(_direction.m_v[2]);
+        const __m128 e1x = _mm_load_ps(_triangles.m_e1[0]), e1y = _mm_load_ps(_triangles.m_e1[1]), e1z = _mm_load_ps(_triangles.m_e1[2]);
+        const __m128 e2x = _mm_load_ps(_triangles.m_e2[0]), e2y = _mm_load_ps(_triangles.m_e2[1]), e2z = _mm_load_ps(_triangles.m_e2[2]);
+
+        // h = direction x edge2, a = edge1 . h
+        const __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        const __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        const __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+        const __m128 absA = _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+        const __m128 f = _mm_div_ps(one, a);
+
+        // s = origin - v0, u = f * (s . h)
+        const __m128 sx = _mm_sub_ps(_mm_set1_ps(_origin.m_v[0]), _mm_load_ps(_triangles.m_v0[0]));
+        const __m128 sy = _mm_sub_ps(_mm_set1_ps(_origin.m_v[1]), _mm_load_ps(_triangles.m_v0[1]));
+        const __m128 sz = _mm_sub_ps(_mm_set1_ps(_origin.m_v[2]), _mm_load_ps(_triangles.m_v0[2]));
+        const __m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+
+        // q = s x edge1, v = f * (direction . q), t = f * (edge2 . q)
+        const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        const __m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+        const __m128 t = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+
+        __m128 hit = _mm_cmpge_ps(absA, _mm_set1_ps(0.000001f));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(t, _mm_set1_ps(_fMinDist)), _mm_cmple_ps(t, _mm_set1_ps(_fMaxDist))));
+
+        _mm_storeu_ps(_pT, t);
+        _mm_storeu_ps(_pU, u);
+        _mm_storeu_ps(_pV, v);
+        return (uint32_t)_mm_movemask_ps(hit);
+    }
+#endif
+
+
+#if defined(USE_AVX)
+    // ray-triangle intersection for 8 triangles (AVX)
+    template <>
+    inline uint32_t triangleIntersect<8>(const TrianglesN<8> &_triangles, const Vec &_origin, const Vec &_direction,
+                                         float _fMinDist, float _fMaxDist, float *_pT, float *_pU, float *_pV)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 dx = _mm256_set1_ps(_direction.m_v[0]), dy = _mm256_set1_ps(_direction.m_v[1]), dz = _mm256_set1_ps(_direction.m_v[2]);
+        const __m256 e1x = _mm256_load_ps(_triangles.m_e1[0]), e1y = _mm256_load_ps(_triangles.m_e1[1]), e1z = _mm256_load_ps(_triangles.m_e1[2]);
+        const __m256 e2x = _mm256_load_ps(_triangles.m_e2[0]), e2y = _mm256_load_ps(_triangles.m_e2[1]), e2z = _mm256_load_ps(_triangles.m_e2[2]);
+
+        // h = direction x edge2, a = edge1 . h
+        const __m256 hx = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+        const __m256 hy = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+        const __m256 hz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+        const __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, hx), _mm256_mul_ps(e1y, hy)), _mm256_mul_ps(e1z, hz));
+        const __m256 absA = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+        const __m256 f = _mm256_div_ps(one, a);
+
+        // s = origin - v0, u = f * (s . h)
+        const __m256 sx = _mm256_sub_ps(_mm256_set1_ps(_origin.m_v[0]), _mm256_load_ps(_triangles.m_v0[0]));
+        const __m256 sy = _mm256_sub_ps(_mm256_set1_ps(_origin.m_v[1]), _mm256_load_ps(_triangles.m_v0[1]));
+        const __m256 sz = _mm256_sub_ps(_mm256_set1_ps(_origin.m_v[2]), _mm256_load_ps(_triangles.m_v0[2]));
+        const __m256 u = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, hx), _mm256_mul_ps(sy, hy)), _mm256_mul_ps(sz, hz)));
+
+        // q = s x edge1, v = f * (direction . q), t = f * (edge2 . q)
+        const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+        const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+        const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+        const __m256 v = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)));
+        const __m256 t = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)));
+
+        __m256 hit = _mm256_cmp_ps(absA, _mm256_set1_ps(0.000001f), _CMP_GE_OQ);
+        hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+        hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+        hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(t, _mm256_set1_ps(_fMinDist), _CMP_GE_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(_fMaxDist), _CMP_LE_OQ)));
+
+        _mm256_storeu_ps(_pT, t);
+        _mm256_storeu_ps(_pU, u);
+        _mm256_storeu_ps(_pV, v);
+        return (uint32_t)_mm256_movemask_ps(hit);
+    }
+#endif
+
+
+};  // namespace CORE
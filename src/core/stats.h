@@ -2,6 +2,7 @@
 
 #include "constants.h"
 #include <cmath>
+#include <cstdint>
 
 
 namespace CORE
@@ -43,6 +44,15 @@ namespace CORE
             return sqrt(variance());
         }
 
+        // standard deviation of the mean (from the sample variance)
+        double standardError() const {
+            return m_uCount > 1 ? sqrt(sampleVariance() / m_uCount) : 0.0;
+        }
+
+        uint64_t count() const {
+            return m_uCount;
+        }
+
      private:
         uint64_t    m_uCount;
         double      m_dMean;
@@ -258,6 +258,12 @@ namespace CORE
                    2 * dist.z() * dist.z();
         }
         
+        // actual surface area of box (used by SAH cost)
+        float surfaceArea() const {
+            Vec dist = m_max - m_min;
+            return 2 * (dist.x() * dist.y() + dist.y() * dist.z() + dist.z() * dist.x());
+        }
+        
         double volume() const {
             Vec dist = m_max - m_min;
             return dist.x() * dist.y() * dist.z();
@@ -267,6 +273,15 @@ namespace CORE
             return m_max - m_min;
         }
         
+        Vec center() const {
+            return (m_min + m_max) * 0.5f;
+        }
+        
+        // true if min > max on any axis (e.g. result of intersecting disjoint boxes)
+        bool empty() const {
+            return (m_min.x() > m_max.x()) || (m_min.y() > m_max.y()) || (m_min.z() > m_max.z());
+        }
+        
         Vec     m_min;
         Vec     m_max;
     };
@@ -292,12 +307,19 @@ namespace CORE
 
     
     // combine bounds into one
-    Bounds combineBoxes(const Bounds &_left, Bounds &_right) {
+    Bounds combineBoxes(const Bounds &_left, const Bounds &_right) {
         return Bounds(perElementMin(_left.m_min, _right.m_min),
                       perElementMax(_left.m_max, _right.m_max));
     }
 
 
+    // intersection of two boxes (empty if they do not overlap)
+    inline Bounds intersectBoxes(const Bounds &_left, const Bounds &_right) {
+        return Bounds(perElementMax(_left.m_min, _right.m_min),
+                      perElementMin(_left.m_max, _right.m_max));
+    }
+
+
     // combine bounds into one
     Bounds combineBoxes(const std::vector<Bounds> &_bounds) {
         Bounds bounds;
@@ -6,11 +6,14 @@
 #include "base/primitive.h"
 #include "base/material.h"
 #include "mesh.h"
+#include "mesh_cache.h"
 
 #include <assimp/Importer.hpp>      // C++ importer interface
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing flags
 
+#include <string>
+
 
 namespace DETAIL
 {
@@ -18,68 +21,142 @@ namespace DETAIL
     class AssimpMesh : public Mesh
     {
      public:
-         AssimpMesh(const char* _pszFilePath, const BASE::Material* _pMaterial)
+         /*
+          Load first mesh from model file.
+          If _bUseCache is set, the built mesh is cached next to the model file ('<model>.cache') and
+          later loads use the cache, skipping the import and BVH build (see fromCache()). Failing to write the
+          cache is not an error, the next load just imports the model again.
+          If _bCompact is set, the mesh is switched to compact storage after loading (see Mesh::compact).
+          */
+         AssimpMesh(const char* _pszFilePath, const BASE::Material* _pMaterial, bool _bUseCache = true, bool _bCompact = false)
              :Mesh(_pMaterial)
          {
-             // load model
+             const std::string strCachePath = std::string(_pszFilePath) + ".cache";
+             uint64_t cacheKey = 0;
+             
+             if (_bUseCache == true) {
+                 cacheKey = MeshCache::key(_pszFilePath, settingsHash());
+                 m_bFromCache = (cacheKey != 0) && (MeshCache::load(*this, strCachePath, cacheKey) == true);
+             }
+             
+             if (m_bFromCache == false) {
+                 loadModel(_pszFilePath);
+                 build(CORE::hardwareThreads());
+                 
+                 if (cacheKey != 0) {
+                     MeshCache::save(*this, strCachePath, cacheKey);
+                 }
+             }
+             
+             if (_bCompact == true) {
+                 compact();
+             }
+         }
+
+         /*
+          Convert an imported mesh (see AssimpScene for loading all meshes of a model).
+          _iThreads is the number of threads used for building the normals and BVH of this mesh.
+          */
+         AssimpMesh(const aiMesh *_pMesh, const BASE::Material* _pMaterial, int _iThreads, bool _bCompact = false)
+             :Mesh(_pMaterial)
+         {
+             loadMesh(_pMesh);
+             build(_iThreads);
+             
+             if (_bCompact == true) {
+                 compact();
+             }
+         }
+
+         /* returns true if the mesh was loaded from the mesh cache */
+         bool fromCache() const {
+             return m_bFromCache;
+         }
+
+         static constexpr unsigned int IMPORT_FLAGS = aiProcess_GenNormals | aiProcess_GenUVCoords | aiProcess_Triangulate;
+
+     private:
+         static constexpr NORMAL_WEIGHT NORMALS = NORMAL_WEIGHT::AREA;
+         
+         // hash of import and build settings (part of cache key)
+         static uint64_t settingsHash() {
+             uint64_t hash = CORE::hashValue(IMPORT_FLAGS);
+             hash = CORE::hashValue(NORMALS, hash);
+             hash = CORE::hashValue(BASE::BVH_SPLIT::SAH, hash);
+             return CORE::hashValue((uint32_t)MAX_LEAF_TRIANGLES, hash);
+         }
+         
+         // complete mesh
+         void build(int _iThreads) {
+             if (hasTriangles() == true) {
+                 buildVertexNormals(NORMALS, _iThreads);
+                 buildBounds();
+                 buildBvh(BASE::BVH_SPLIT::SAH, BASE::BVH_MAX_DUPLICATION, _iThreads);
+             }
+         }
+         
+         // import model (first mesh)
+         void loadModel(const char* _pszFilePath) {
              Assimp::Importer importer;
-             const aiScene* pScene = importer.ReadFile(_pszFilePath, aiProcess_GenNormals | aiProcess_GenUVCoords | aiProcess_Triangulate);
-
-             if (pScene->HasMeshes() == true) {
-                 // load first mesh
-                 const aiMesh *pMesh = pScene->mMeshes[0];
-                 std::vector<MeshVertex> vertices;
-                 vertices.reserve(pMesh->mNumVertices);
-
-                 // load mesh vertices
-                 for (int i = 0; i < (int)pMesh->mNumVertices; i++) {
-                     MeshVertex vertex;
-                     if (pMesh->HasPositions() == true) {
-                         const aiVector3D &aiVertex = pMesh->mVertices[i];
-                         vertex.m_v = CORE::Vec(aiVertex.x, aiVertex.y, aiVertex.z);
-                     }
-
-                     if (pMesh->HasTextureCoords(0) == true) {
-                         const aiVector3D &aiUv = pMesh->mTextureCoords[0][i];
-                         vertex.m_uv = CORE::Uv(aiUv.x, aiUv.y);
-                     }
-
-                     if (pMesh->HasNormals() == true) {
-                         const aiVector3D &aiNormal = pMesh->mNormals[i];
-                         vertex.m_normal = CORE::Vec(aiNormal.x, aiNormal.y, aiNormal.z);
-                     }
-
-                     vertices.push_back(vertex);
+             const aiScene* pScene = importer.ReadFile(_pszFilePath, IMPORT_FLAGS);
+
+             if ( (pScene != nullptr) && (pScene->HasMeshes() == true) ) {
+                 loadMesh(pScene->mMeshes[0]);
+             }
+         }
+
+         // convert vertices and triangles of mesh (faces that are not triangles, i.e. points and lines, are skipped)
+         void loadMesh(const aiMesh *_pMesh) {
+             std::vector<MeshVertex> vertices;
+             vertices.reserve(_pMesh->mNumVertices);
+
+             // load mesh vertices
+             for (int i = 0; i < (int)_pMesh->mNumVertices; i++) {
+                 MeshVertex vertex;
+                 if (_pMesh->HasPositions() == true) {
+                     const aiVector3D &aiVertex = _pMesh->mVertices[i];
+                     vertex.m_v = CORE::Vec(aiVertex.x, aiVertex.y, aiVertex.z);
                  }
 
-                 setVertices(vertices);
+                 if (_pMesh->HasTextureCoords(0) == true) {
+                     const aiVector3D &aiUv = _pMesh->mTextureCoords[0][i];
+                     vertex.m_uv = CORE::Uv(aiUv.x, aiUv.y);
+                 }
 
-                 // load indices
-                 std::vector<MeshTriangle> triangles;
-                 triangles.reserve(pMesh->mNumFaces);
+                 if (_pMesh->HasNormals() == true) {
+                     const aiVector3D &aiNormal = _pMesh->mNormals[i];
+                     vertex.m_normal = CORE::Vec(aiNormal.x, aiNormal.y, aiNormal.z);
+                 }
 
-                 for (int i = 0; i < (int)pMesh->mNumFaces; i++) {
-                     MeshTriangle triangle;
-                     const aiFace &face = pMesh->mFaces[i];
-                     triangle.m_v[0] = face.mIndices[0];
-                     triangle.m_v[1] = face.mIndices[1];
-                     triangle.m_v[2] = face.mIndices[2];
+                 vertices.push_back(vertex);
+             }
 
-                     // TODO: is this the correct way of finding the triangle normal (when using aiProcess_GenNormals)
-                     triangle.m_normal = vertices[face.mIndices[0]].m_normal;
+             // load indices
+             std::vector<MeshTriangle> triangles;
+             triangles.reserve(_pMesh->mNumFaces);
 
-                     triangles.push_back(triangle);
+             for (int i = 0; i < (int)_pMesh->mNumFaces; i++) {
+                 const aiFace &face = _pMesh->mFaces[i];
+                 if (face.mNumIndices != 3) {
+                     continue;
                  }
+                 
+                 MeshTriangle triangle;
+                 triangle.m_v[0] = face.mIndices[0];
+                 triangle.m_v[1] = face.mIndices[1];
+                 triangle.m_v[2] = face.mIndices[2];
+
+                 // TODO: is this the correct way of finding the triangle normal (when using aiProcess_GenNormals)
+                 triangle.m_normal = vertices[face.mIndices[0]].m_normal;
 
-                 setTriangles(triangles);
+                 triangles.push_back(triangle);
              }
 
-             // complete mesh
-             //buildVertexNormals();
-             buildBounds();
-             buildBvh();
+             setVertices(vertices);
+             setTriangles(triangles);
          }
 
+         bool    m_bFromCache = false;
     };
 
 };  // namespace DETAIL
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "core/constants.h"
+#include "core/vec3.h"
+#include "core/parallel.h"
+#include "base/primitive.h"
+#include "base/material.h"
+#include "base/scene.h"
+#include "assimp_mesh.h"
+
+#include <assimp/Importer.hpp>      // C++ importer interface
+#include <assimp/scene.h>           // Output data structure
+#include <assimp/postprocess.h>     // Post processing flags
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+
+namespace DETAIL
+{
+    /*
+     Imports all meshes and the node hierarchy of a model file.
+     Every aiMesh is converted to one AssimpMesh primitive (on multiple threads, largest meshes first) that is
+     shared by all nodes referencing it, and every mesh reference of a node becomes a PrimitiveInstance with the
+     node transform (accumulated from the root node) as axis.
+     All meshes use the given material. With _bCompact, meshes are switched to compact storage (see Mesh::compact).
+     NOTE: CORE::Axis only holds rotation, uniform scale and translation. Node transforms with non-uniform scale
+     or shear are approximated (orthonormalized axes, volume preserving scale).
+     */
+    class AssimpScene
+    {
+     public:
+        /* load model into scene (with _axis as transform of the root node); returns created instances (none if loading failed) */
+        template <typename scene_ptr_type>
+        static std::vector<BASE::PrimitiveInstance*> load(scene_ptr_type &_pScene, const char* _pszFilePath, const BASE::Material* _pMaterial,
+                                                          const CORE::Axis &_axis = CORE::axisIdentity(), bool _bCompact = false,
+                                                          int _iThreads = CORE::hardwareThreads())
+        {
+            std::vector<BASE::PrimitiveInstance*> instances;
+
+            Assimp::Importer importer;
+            const aiScene* pAiScene = importer.ReadFile(_pszFilePath, AssimpMesh::IMPORT_FLAGS);
+            if ( (pAiScene == nullptr) || (pAiScene->mRootNode == nullptr) ) {
+                return instances;
+            }
+
+            // convert meshes and add them to the scene (scene resources are not thread safe)
+            auto meshes = convertMeshes(pAiScene, _pMaterial, _bCompact, _iThreads);
+            std::vector<const BASE::Primitive*> primitives(meshes.size(), nullptr);
+            for (size_t i = 0; i < meshes.size(); i++) {
+                if (meshes[i]->hasTriangles() == true) {
+                    primitives[i] = static_cast<BASE::Primitive*>(_pScene->addResource(std::move(meshes[i])));
+                }
+            }
+
+            // instance meshes for every node
+            std::vector<std::pair<const aiNode*, aiMatrix4x4>> stack = {{pAiScene->mRootNode, axisMatrix(_axis)}};
+            while (stack.empty() == false) {
+                auto [pNode, parent] = stack.back();
+                stack.pop_back();
+
+                const aiMatrix4x4 transform = parent * pNode->mTransformation;
+                for (unsigned int i = 0; i < pNode->mNumChildren; i++) {
+                    stack.emplace_back(pNode->mChildren[i], transform);
+                }
+
+                if (pNode->mNumMeshes == 0) {
+                    continue;
+                }
+
+                CORE::Axis axis;
+                if (matrixAxis(transform, axis) == false) {
+                    continue;   // degenerate transform
+                }
+
+                for (unsigned int i = 0; i < pNode->mNumMeshes; i++) {
+                    if (const BASE::Primitive *pPrimitive = primitives[pNode->mMeshes[i]]; pPrimitive != nullptr) {
+                        instances.push_back(BASE::createPrimitiveInstance(_pScene, axis, pPrimitive));
+                    }
+                }
+            }
+
+            return instances;
+        }
+
+     private:
+        // convert all meshes (one mesh per worker at a time, largest first)
+        static std::vector<std::unique_ptr<AssimpMesh>> convertMeshes(const aiScene* _pAiScene, const BASE::Material* _pMaterial, bool _bCompact, int _iThreads) {
+            const size_t count = _pAiScene->mNumMeshes;
+            std::vector<std::unique_ptr<AssimpMesh>> meshes(count);
+
+            std::vector<uint32_t> order(count);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&](uint32_t _uA, uint32_t _uB){
+                return _pAiScene->mMeshes[_uA]->mNumFaces > _pAiScene->mMeshes[_uB]->mNumFaces;
+            });
+
+            // threads left over (fewer meshes than threads) are used by the mesh builds
+            const int workers = (int)std::min<size_t>(std::max(_iThreads, 1), std::max<size_t>(count, 1));
+            const int meshThreads = std::max(1, _iThreads / std::max((int)count, 1));
+
+            std::atomic<size_t> next(0);
+            CORE::parallelFor(workers, workers, 1, [&](size_t, size_t, size_t){
+                for (size_t i = next++; i < count; i = next++) {
+                    meshes[order[i]] = std::make_unique<AssimpMesh>(_pAiScene->mMeshes[order[i]], _pMaterial, meshThreads, _bCompact);
+                }
+            });
+
+            return meshes;
+        }
+
+        // axis as 4x4 transform matrix
+        static aiMatrix4x4 axisMatrix(const CORE::Axis &_axis) {
+            const CORE::Vec x = _axis.m_x * _axis.m_fScale;
+            const CORE::Vec y = _axis.m_y * _axis.m_fScale;
+            const CORE::Vec z = _axis.m_z * _axis.m_fScale;
+            const CORE::Vec &o = _axis.m_origin;
+
+            aiMatrix4x4 m;
+            m.a1 = x.x(); m.a2 = y.x(); m.a3 = z.x(); m.a4 = o.x();
+            m.b1 = x.y(); m.b2 = y.y(); m.b3 = z.y(); m.b4 = o.y();
+            m.c1 = x.z(); m.c2 = y.z(); m.c3 = z.z(); m.c4 = o.z();
+            m.d1 = 0;     m.d2 = 0;     m.d3 = 0;     m.d4 = 1;
+            return m;
+        }
+
+        /*
+         Axis from 4x4 transform matrix (columns are the transformed unit vectors and the origin).
+         Non-uniform scale and shear are approximated (see class comment). Returns false for degenerate matrices.
+         */
+        static bool matrixAxis(const aiMatrix4x4 &_m, CORE::Axis &_axis) {
+            CORE::Vec x(_m.a1, _m.b1, _m.c1);
+            CORE::Vec y(_m.a2, _m.b2, _m.c2);
+            CORE::Vec z(_m.a3, _m.b3, _m.c3);
+
+            const float scale = std::cbrt(std::fabs(x * crossProduct(y, z)));
+            if (scale <= 0) {
+                return false;
+            }
+
+            // Gram-Schmidt (keeps handedness of mirrored transforms)
+            x = x.normalized();
+            y = (y - x * (x * y)).normalized();
+            z = (z - x * (x * z) - y * (y * z)).normalized();
+
+            _axis = CORE::Axis(x, y, z, CORE::Vec(_m.a4, _m.b4, _m.c4), scale);
+            return true;
+        }
+    };
+
+};  // namespace DETAIL
@@ -6,6 +6,8 @@
 #include "base/material.h"
 #include "base/intersect.h"
 
+#include <algorithm>
+
 
 namespace DETAIL
 {
@@ -25,6 +27,16 @@ namespace DETAIL
             return _sc;
         }
         
+        /* Probability density of sampling _direction (cosine weighted around the normal). */
+        virtual float pdf(const BASE::Intersect &_hit, const CORE::Vec &_direction) const override {
+            return std::max(_direction * _hit.m_normal, 0.0f) / pif;
+        }
+        
+        /* Lambertian reflection (albedo/pi) with cosine term. */
+        virtual CORE::Color eval(const BASE::Intersect &_hit, const CORE::Vec &_direction) const override {
+            return m_color * (std::max(_direction * _hit.m_normal, 0.0f) / pif);
+        }
+        
      private:
         CORE::Color           m_color;
     };
@@ -50,6 +62,11 @@ namespace DETAIL
             return _sc;
        }
        
+        /* Returns the light emitted at the intersection point (only emits outwards). */
+        virtual CORE::Color emitted(const BASE::Intersect &_hit) const override {
+            return _hit.m_bInside == false ? m_color : CORE::COLOR::Black;
+        }
+       
      private:
         CORE::Color            m_color;
     };
@@ -72,6 +89,37 @@ namespace DETAIL
             _sc.m_emitted *= m_color;
             return _sc;
         }
+        
+        /*
+         Probability density of sampling _direction: the normalized reflection plus a random offset in the sphere of
+         radius m_fScatter. Integrates that uniform density along the ray in _direction through the offset sphere.
+         */
+        virtual float pdf(const BASE::Intersect &_hit, const CORE::Vec &_direction) const override {
+            if (m_fScatter <= 0) {
+                return 0;   // mirror
+            }
+            
+            const CORE::Vec center = reflect(_hit.m_priRay.m_direction, _hit.m_normal);
+            const float c = _direction * center;
+            const float disc = c * c - center.sizeSqr() + m_fScatter * m_fScatter;
+            if (disc <= 0) {
+                return 0;
+            }
+            
+            const float root = sqrt(disc);
+            const float t1 = c + root;
+            const float t0 = std::max(c - root, 0.0f);
+            if (t1 <= t0) {
+                return 0;
+            }
+            
+            return (t1 * t1 * t1 - t0 * t0 * t0) / (4 * pif * m_fScatter * m_fScatter * m_fScatter);
+        }
+        
+        /* Attenuation is constant over the scattered directions. */
+        virtual CORE::Color eval(const BASE::Intersect &_hit, const CORE::Vec &_direction) const override {
+            return m_color * pdf(_hit, _direction);
+        }
 
      private:
         CORE::Color    m_color;
@@ -5,6 +5,7 @@
 #include "base/loader.h"
 #include "base/scene.h"
 #include "assimp_mesh.h"
+#include "assimp_scene.h"
 #include "simple_camera.h"
 #include "basic_materials.h"
 #include "tex_materials.h"
@@ -158,6 +159,53 @@ namespace DETAIL
     };
 
 
+    /*
+     Model file imported with AssimpScene (all meshes and the node hierarchy, meshes shared by the instances
+     referencing them). The root node is placed with _axis (the default matches the dragon scene).
+     */
+    class LoaderModelScene : public BASE::Loader
+    {
+    public:
+        LoaderModelScene(const std::string &_strFilePath = "models/dragon_1.obj",
+                         const CORE::Axis &_axis = CORE::axisEulerZYX(0, 0.7f, -pif / 2, CORE::Vec(0, 30, 0), 0.5f))
+            :m_strFilePath(_strFilePath),
+             m_axis(_axis)
+        {}
+        
+        virtual std::string& name() const override {
+            static std::string name = "model_scene";
+            return name;
+        }
+
+        virtual std::string& description() const override {
+            static std::string desc = "Model loaded with all meshes and node transforms";
+            return desc;
+        }
+
+        virtual std::unique_ptr<BASE::Scene> loadScene() const override {
+            auto pScene = std::make_unique<SimpleSceneBvh>(CORE::Color(0.1f, 0.1f, 0.1f));
+            auto pDiffuse = BASE::createMaterial<Diffuse>(pScene, CORE::Color(0.9f, 0.9f, 0.9f));
+            auto pDiffuseFloor = BASE::createMaterial<DiffuseCheckered>(pScene, CORE::Color(0.8f, 0.8f, 0.1f), CORE::Color(0.8f, 0.1f, 0.1f), 2);
+            auto pLight = BASE::createMaterial<Light>(pScene, CORE::Color(50.0f, 50.0f, 50.0f));
+
+            BASE::createPrimitiveInstance<Disc>(pScene, CORE::axisIdentity(), 500.0f, pDiffuseFloor);
+            BASE::createPrimitiveInstance<Sphere>(pScene, CORE::axisTranslation(CORE::Vec(0, 100, 0)), 8.0f, pLight, true);
+            AssimpScene::load(pScene, m_strFilePath.c_str(), pDiffuse, m_axis);
+
+            pScene->build();   // build BVH
+            return pScene;
+        }
+
+        virtual std::unique_ptr<BASE::Camera> loadCamera() const override {
+            return std::make_unique<SimpleCamera>(CORE::Vec(0, 40, 120), CORE::Vec(0, 1, 0), CORE::Vec(0, 10, 0), deg2rad(60), 0.2f, 100.0f);
+        }
+        
+    private:
+        std::string     m_strFilePath;
+        CORE::Axis      m_axis;
+    };
+
+
     class LoaderGlassSphereScene  : public BASE::Loader
     {
      public:
@@ -586,6 +634,45 @@ namespace DETAIL
     };
 
 
+    class LoaderFogOccluderScene  : public BASE::Loader
+    {
+     public:
+        virtual std::string &name() const override {
+            static std::string name = "fog_occluder";
+            return name;
+        }
+        
+        virtual std::string &description() const override {
+            static std::string desc = "Spheres reaching out of dense fog (fog behind a sphere must not replace its closer hit)";
+            return desc;
+        }
+
+        virtual std::unique_ptr<BASE::Scene> loadScene() const override {
+            auto pScene = std::make_unique<SimpleSceneBvh>(CORE::Color(0.1f, 0.1f, 0.15f));
+            auto pDiffuseFloor = BASE::createMaterial<DiffuseCheckered>(pScene, CORE::Color(0.8f, 0.8f, 0.8f), CORE::Color(0.4f, 0.4f, 0.4f), 2);
+            auto pLight = BASE::createMaterial<Light>(pScene, CORE::Color(20.0f, 20.0f, 20.0f));
+            auto pRed = BASE::createMaterial<Diffuse>(pScene, CORE::Color(0.95f, 0.0f, 0.0f));
+            auto pBlue = BASE::createMaterial<Diffuse>(pScene, CORE::Color(0.0f, 0.0f, 0.95f));
+            auto pFog = BASE::createMaterial<EnvironmentMap>(pScene, CORE::Color(0.9f, 0.9f, 0.9f));
+
+            BASE::createPrimitiveInstance<Disc>(pScene, CORE::axisIdentity(), 500.0f, pDiffuseFloor);
+            BASE::createPrimitiveInstance<Sphere>(pScene, CORE::axisTranslation(CORE::Vec(0, 120, 60)), 20.0f, pLight, true);
+
+            // spheres poking out of the front and the top of the fog (their bounds are entered before the fog box)
+            BASE::createPrimitiveInstance<SmokeBox>(pScene, CORE::axisTranslation(CORE::Vec(0, 30, 0)), CORE::Vec(200, 60, 100), pFog, 0.05f);
+            BASE::createPrimitiveInstance<Sphere>(pScene, CORE::axisTranslation(CORE::Vec(-30, 25, 45)), 15.0f, pRed);
+            BASE::createPrimitiveInstance<Sphere>(pScene, CORE::axisTranslation(CORE::Vec(30, 55, 10)), 15.0f, pBlue);
+
+            pScene->build();   // build BVH
+            return pScene;
+        }
+
+        virtual std::unique_ptr<BASE::Camera> loadCamera() const override {
+            return std::make_unique<SimpleCamera>(CORE::Vec(0, 70, 180), CORE::Vec(0, 1, 0), CORE::Vec(0, 30, 0), deg2rad(50), 0.1f, 180.0f);
+        }
+    };
+
+
     class LoaderCornellBox  : public BASE::Loader
     {
      public:
@@ -678,6 +765,7 @@ namespace DETAIL
         return std::vector<std::shared_ptr<BASE::Loader>>{
             std::make_shared<LoaderDefaultScene>(),
             std::make_shared<LoaderDragonScene>(),
+            std::make_shared<LoaderModelScene>(),
             std::make_shared<LoaderGlassSphereScene>(),
             std::make_shared<LoaderMandleBulbZoom>(),
             std::make_shared<LoaderRaymarchingBlobs>(),
@@ -689,6 +777,7 @@ namespace DETAIL
             std::make_shared<LoaderSubsurfaceBlobs>(),
             std::make_shared<LoaderBulbFieldScene>(),
             std::make_shared<LoaderFogScene>(),
+            std::make_shared<LoaderFogOccluderScene>(),
             std::make_shared<LoaderCornellBox>(),
             std::make_shared<LoaderFractalBox>()
         };
@@ -3,11 +3,15 @@
 #include "core/constants.h"
 #include "core/vec3.h"
 #include "core/uv.h"
+#include "core/parallel.h"
+#include "core/quantize.h"
 #include "base/bvh.h"
 #include "base/primitive.h"
 #include "base/material.h"
 
-#include <queue>
+#include <algorithm>
+#include <array>
+#include <type_traits>
 
 
 namespace DETAIL
@@ -26,6 +30,14 @@ namespace DETAIL
         CORE::Vec         m_normal;
     };
     
+    /* vertex indices of a cluster of triangles in compact meshes (16-bit offsets from a base vertex, or 32-bit indices) */
+    struct MeshCluster {
+        constexpr static uint32_t WIDE = 0x80000000;   // offset is into the 32-bit index array
+        
+        uint32_t          m_uBaseVertex = 0;
+        uint32_t          m_uOffset = 0;
+    };
+    
     // output of traingle intersection test
     struct MeshIntersect
     {
@@ -45,7 +57,6 @@ namespace DETAIL
             return m_fPositionOnRay > _rhs.m_fPositionOnRay;
         }
 
-        BASE::BvhNode<MeshTriangle> *m_pNode = nullptr;
         CORE::Uv m_uv;
         int32_t m_iTriangleIndex = -1;
         float m_fPositionOnRay = -1;
@@ -87,15 +98,85 @@ namespace DETAIL
         return tri;
     }
     
+    
+    /*
+     Returns the bounds of the part of a triangle inside the given box (clips the triangle against each
+     box plane). Returns empty bounds if the triangle is outside the box.
+     */
+    inline CORE::Bounds clipTriangleBounds(const CORE::Vec &_v0, const CORE::Vec &_v1, const CORE::Vec &_v2, const CORE::Bounds &_box) {
+        std::array<CORE::Vec, 9> polygon = {_v0, _v1, _v2};
+        std::array<CORE::Vec, 9> clipped;
+        int n = 3;
+        
+        for (int axis = 0; axis < 3; axis++) {
+            for (int side = 0; side < 2; side++) {
+                const float plane = side == 0 ? _box.m_min.m_v[axis] : _box.m_max.m_v[axis];
+                auto inside = [&](const CORE::Vec &_v) {
+                    return side == 0 ? _v.m_v[axis] >= plane : _v.m_v[axis] <= plane;
+                };
+                
+                int m = 0;
+                for (int i = 0; i < n; i++) {
+                    const auto &v = polygon[i];
+                    const auto &next = polygon[(i + 1) % n];
+                    
+                    if (inside(v) == true) {
+                        clipped[m++] = v;
+                    }
+                    
+                    if (inside(v) != inside(next)) {
+                        auto p = v + (next - v) * ((plane - v.m_v[axis]) / (next.m_v[axis] - v.m_v[axis]));
+                        p.m_v[axis] = plane;
+                        clipped[m++] = p;
+                    }
+                }
+                
+                polygon = clipped;
+                n = m;
+                if (n == 0) {
+                    return CORE::Bounds(_box.m_max, _box.m_min);  // empty
+                }
+            }
+        }
+        
+        CORE::Bounds bounds(polygon[0], polygon[0]);
+        for (int i = 1; i < n; i++) {
+            bounds.m_min = perElementMin(bounds.m_min, polygon[i]);
+            bounds.m_max = perElementMax(bounds.m_max, polygon[i]);
+        }
+        
+        return bounds;
+    }
+    
         
+    class MeshCache;
+    
+    
+    /* vertex normal weighting (of adjacent triangle normals) */
+    enum class NORMAL_WEIGHT {
+        NONE = 1,       // plain average of triangle normals
+        AREA = 2,       // weighted by triangle area
+        ANGLE = 3       // weighted by triangle angle at vertex
+    };
+    
+    
     /* Mesh defined by vertices, triangle indices and a material */
     class Mesh        : public BASE::Primitive
     {
+        friend class MeshCache;
+        
+     protected:
+        const static uint32_t   MAX_LEAF_TRIANGLES  = 4;      // triangles per BVH leaf
+        constexpr static int    TRIANGLE_PACKET_SIZE = CORE::SIMD_WIDTH;    // triangles per SIMD hit test
+        constexpr static uint32_t CLUSTER_TRIANGLES = 64;   // triangles per index cluster (compact meshes)
+        using TrianglePacket = CORE::TrianglesN<TRIANGLE_PACKET_SIZE>;
+        
      public:
         Mesh(const BASE::Material *_pMaterial)
             :m_pMaterial(_pMaterial),
              m_bBoundsInit(false),
-             m_bUseVertexNormals(false)
+             m_bUseVertexNormals(false),
+             m_bCompact(false)
         {}
 
         /* Returns the material used for rendering, etc. */
@@ -105,76 +186,40 @@ namespace DETAIL
         
         /* Quick node hit check (populates at least node and time properties of intercept) */
         virtual bool hit(BASE::Intersect &_hit) const override {
+            constexpr int N = TRIANGLE_PACKET_SIZE;
             MeshIntersect triHit;
             uint32_t objectHits = 0;
             uint32_t boxHits = 0;
             
-            /*
-            boxHits = BASE::checkBvhHit(m_pBvhRoot, _hit.m_priRay,
-                              [&](const MeshTriangle *_pTriangle, const CORE::Ray &_ray){
-                                    MeshIntersect nh = getMeshIntersect(_pTriangle, _ray);
-                                    if (nh == true) {
-                                        objectHits++;
-                                        
-                                        if ( (triHit == false) ||
-                                             (nh < triHit) )
-                                        {
-                                            triHit = nh;
-                                        }
-                                    }
-                              });
-            
-            */
-            
-            
-            std::priority_queue<MeshIntersect, std::vector<MeshIntersect>, std::greater<MeshIntersect>> queue;
-            MeshIntersect root;
-            root.m_pNode = m_pBvhRoot;
-            queue.push(root);
-
-            while (queue.empty() == false) {
-                MeshIntersect node = queue.top();
-                queue.pop();
-                
-                if (node.m_iTriangleIndex >= 0) {
-                    // we have our hit
-                    triHit = node;
-                    break;
-                }
-                else {
-                    BASE::BvhNode<MeshTriangle> *pBvhNode = node.m_pNode;
-                    if (pBvhNode->m_pPrimitive != nullptr) {
-                        objectHits++;
-                        MeshIntersect nh = getMeshIntersect(pBvhNode->m_pPrimitive, _hit.m_priRay);
-                        if (nh.m_iTriangleIndex >= 0) {
-                            nh.m_pNode = pBvhNode;
-                            queue.push(nh);
-                        }
-                    }
-                    else {
-                        if (pBvhNode->m_pLeft != nullptr) {
-                            if (float t = pBvhNode->m_pLeft->intersect(_hit.m_priRay); t >= 0) {
-                                boxHits++;
-                                MeshIntersect nh;
-                                nh.m_fPositionOnRay = t;
-                                nh.m_pNode = pBvhNode->m_pLeft;
-                                queue.push(nh);
-                            }
-                        }
-
-                        if (pBvhNode->m_pRight != nullptr) {
-                            if (float t = pBvhNode->m_pRight->intersect(_hit.m_priRay); t >= 0) {
-                                boxHits++;
-                                MeshIntersect nh;
-                                nh.m_fPositionOnRay = t;
-                                nh.m_pNode = pBvhNode->m_pRight;
-                                queue.push(nh);
-                            }
-                        }
-                    }
-                }
-            }
-            
+            // triangles are stored in leaf order, so leaves are (unaligned) ranges of triangle packets
+            boxHits = BASE::checkBvhLeafHit(m_bvh, _hit.m_priRay,
+                                            [&](uint32_t _uFirst, uint32_t _uCount, const CORE::Ray &_ray){
+                                                const uint32_t end = _uFirst + _uCount;
+                                                float closest = _ray.m_fMaxDist;
+                                                objectHits += _uCount;
+                                                
+                                                for (uint32_t p = _uFirst / N; p * N < end; p++) {
+                                                    const uint32_t first = p * N;
+                                                    const uint32_t laneBegin = _uFirst > first ? _uFirst - first : 0;
+                                                    const uint32_t laneEnd = std::min(end - first, (uint32_t)N);
+                                                    
+                                                    alignas(32) float t[N], u[N], v[N];
+                                                    uint32_t mask = CORE::triangleIntersect(m_packets[p], _ray.m_origin, _ray.m_direction,
+                                                                                            _ray.m_fMinDist, closest, t, u, v);
+                                                    mask &= ((1u << laneEnd) - 1) & ~((1u << laneBegin) - 1);
+                                                    
+                                                    for (int i = 0; i < N; i++) {
+                                                        if ( (mask & (1u << i)) && (t[i] < closest) ) {
+                                                            closest = t[i];
+                                                            triHit.m_fPositionOnRay = t[i];
+                                                            triHit.m_uv = CORE::Uv(u[i], v[i]);   // NOTE: Barycentric UV (u + v + w = 1)
+                                                            triHit.m_iTriangleIndex = (int32_t)(first + i);
+                                                        }
+                                                    }
+                                                }
+                                                
+                                                return closest < _ray.m_fMaxDist ? closest : -1.0f;
+                                            });
 
             if (triHit == true) {
                 _hit.m_uv = triHit.m_uv;
@@ -188,30 +233,50 @@ namespace DETAIL
             return false;
         }
 
+        /* Checks for any triangle hit within the ray distance limits (stops on the first hit). */
+        virtual bool occluded(const CORE::Ray &_ray) const override {
+            constexpr int N = TRIANGLE_PACKET_SIZE;
+            return BASE::checkBvhLeafAny(m_bvh, _ray,
+                                         [&](uint32_t _uFirst, uint32_t _uCount, const CORE::Ray &_leafRay){
+                                             const uint32_t end = _uFirst + _uCount;
+                                             for (uint32_t p = _uFirst / N; p * N < end; p++) {
+                                                 const uint32_t first = p * N;
+                                                 const uint32_t laneBegin = _uFirst > first ? _uFirst - first : 0;
+                                                 const uint32_t laneEnd = std::min(end - first, (uint32_t)N);
+                                                 
+                                                 alignas(32) float t[N], u[N], v[N];
+                                                 const uint32_t mask = CORE::triangleIntersect(m_packets[p], _leafRay.m_origin, _leafRay.m_direction,
+                                                                                         _leafRay.m_fMinDist, _leafRay.m_fMaxDist, t, u, v);
+                                                 if ( (mask & ((1u << laneEnd) - 1) & ~((1u << laneBegin) - 1)) != 0 ) {
+                                                     return true;
+                                                 }
+                                             }
+                                             
+                                             return false;
+                                         });
+        }
+
         /* Completes the node intersect properties. */
         virtual BASE::Intersect &intersect(BASE::Intersect &_hit) const override {
-            const auto &t = m_triangles[_hit.m_iTriangleIndex];
-            const auto &v0 = m_vertices[t.m_v[0]];
-            const auto &v1 = m_vertices[t.m_v[1]];
-            const auto &v2 = m_vertices[t.m_v[2]];
+            const auto v = triangleVertices((uint32_t)_hit.m_iTriangleIndex);
             
             _hit.m_position = _hit.m_priRay.position(_hit.m_fPositionOnRay);
             _hit.m_bInside = (_hit.m_normal * _hit.m_priRay.m_direction) >= 0;
             
             // interpolate vertex normals (from hit barycentric uv)
             if (m_bUseVertexNormals == true) {
-                _hit.m_normal = _hit.m_uv.u() * v1.m_normal +
-                                _hit.m_uv.v() * v2.m_normal +
-                                (1 - _hit.m_uv.u() - _hit.m_uv.v()) * v0.m_normal;
+                _hit.m_normal = _hit.m_uv.u() * vertexNormal(v[1]) +
+                                _hit.m_uv.v() * vertexNormal(v[2]) +
+                                (1 - _hit.m_uv.u() - _hit.m_uv.v()) * vertexNormal(v[0]);
             }
             else {
-                _hit.m_normal = t.m_normal;
+                _hit.m_normal = triangleNormal((uint32_t)_hit.m_iTriangleIndex);
             }
 
             // calc texture coords (from hit barycentric uv)
-            _hit.m_uv = _hit.m_uv.u() * v1.m_uv +
-                        _hit.m_uv.v() * v2.m_uv +
-                        (1 - _hit.m_uv.u() - _hit.m_uv.v()) * v0.m_uv;
+            _hit.m_uv = _hit.m_uv.u() * vertexUv(v[1]) +
+                        _hit.m_uv.v() * vertexUv(v[2]) +
+                        (1 - _hit.m_uv.u() - _hit.m_uv.v()) * vertexUv(v[0]);
 
             return _hit;
         }
@@ -247,33 +312,75 @@ namespace DETAIL
             }
         }
         
-        /* Calc vertex normals.
-           Should be called after triangle normals have been calculated.
-           Will enable the use of vertex normals (with interpolation).
+        /*
+         Calc vertex normals (one pass over triangles and one over vertices, O(V + T), on multiple threads).
+         Triangle normals are accumulated per vertex, weighted by triangle area, by the triangle angle at
+         the vertex, or not weighted at all.
+         Will enable the use of vertex normals (with interpolation).
          */
-        void buildVertexNormals() {
+        void buildVertexNormals(NORMAL_WEIGHT _weight = NORMAL_WEIGHT::AREA, int _iThreads = CORE::hardwareThreads()) {
+            constexpr size_t MIN_CHUNK_SIZE = 4096;
             m_bUseVertexNormals = true;
             
-            for (size_t i = 0; i < m_vertices.size(); i++) {
-                auto &v = m_vertices[i];
-                v.m_normal = CORE::Vec();
-                int count = 0;
-                
-                for (size_t j = 0; j < m_triangles.size(); j++) {
-                    auto &t = m_triangles[j];
+            // weighted triangle normal contributions per triangle corner
+            std::vector<CORE::Vec> corners(m_triangles.size() * 3);
+            CORE::parallelFor(m_triangles.size(), _iThreads, MIN_CHUNK_SIZE, [&](size_t, size_t _uBegin, size_t _uEnd) {
+                for (size_t i = _uBegin; i < _uEnd; i++) {
+                    const auto &t = m_triangles[i];
+                    const CORE::Vec v[3] = {m_vertices[t.m_v[0]].m_v, m_vertices[t.m_v[1]].m_v, m_vertices[t.m_v[2]].m_v};
+                    const auto normal = crossProduct(v[1] - v[0], v[2] - v[0]);   // length is twice the area
+                    const float length = normal.size();
+                    if (length <= 0) {
+                        continue;   // degenerate triangle
+                    }
                     
-                    for (size_t k = 0; k < 3; k++) {
-                        if (i == t.m_v[k]) {
-                            v.m_normal += t.m_normal;
-                            count++;
+                    for (int k = 0; k < 3; k++) {
+                        if (_weight == NORMAL_WEIGHT::AREA) {
+                            corners[i * 3 + k] = normal;
+                        }
+                        else if (_weight == NORMAL_WEIGHT::ANGLE) {
+                            const auto e1 = (v[(k + 1) % 3] - v[k]).normalized();
+                            const auto e2 = (v[(k + 2) % 3] - v[k]).normalized();
+                            corners[i * 3 + k] = normal * (acosf(clamp(e1 * e2, -1.0f, 1.0f)) / length);
+                        }
+                        else {
+                            corners[i * 3 + k] = normal / length;
                         }
                     }
                 }
-                
-                if (count > 0) {
-                    v.m_normal /= (float)count;
+            });
+            
+            // triangle corners per vertex (CSR: vertex i uses corners [offsets[i], offsets[i + 1]))
+            std::vector<uint32_t> offsets(m_vertices.size() + 1, 0);
+            for (const auto &t : m_triangles) {
+                for (int k = 0; k < 3; k++) {
+                    offsets[t.m_v[k] + 1]++;
                 }
             }
+            
+            for (size_t i = 1; i < offsets.size(); i++) {
+                offsets[i] += offsets[i - 1];
+            }
+            
+            std::vector<uint32_t> vertexCorners(corners.size());
+            std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < m_triangles.size(); i++) {
+                for (int k = 0; k < 3; k++) {
+                    vertexCorners[next[m_triangles[i].m_v[k]]++] = (uint32_t)(i * 3 + k);
+                }
+            }
+            
+            // sum contributions per vertex
+            CORE::parallelFor(m_vertices.size(), _iThreads, MIN_CHUNK_SIZE, [&](size_t, size_t _uBegin, size_t _uEnd) {
+                for (size_t i = _uBegin; i < _uEnd; i++) {
+                    CORE::Vec normal;
+                    for (uint32_t j = offsets[i]; j < offsets[i + 1]; j++) {
+                        normal += corners[vertexCorners[j]];
+                    }
+                    
+                    m_vertices[i].m_normal = normal.size() > 0 ? normal.normalized() : normal;
+                }
+            });
         }
 
         /* calc mesh bounds */
@@ -300,35 +407,138 @@ namespace DETAIL
             }
         }
 
-        /* build acceleration structures etc. */
-        void buildBvh() {
-            std::vector<const MeshTriangle*> trianglePtrs = getTrianglePtrs();
-            m_pBvhRoot = BASE::buildBvhRoot(trianglePtrs,
-                                            [&](){
-                                                 m_memory.push_back(std::make_unique<BASE::BvhNode<MeshTriangle>>());
-                                                 return m_memory.back().get();
-                                            });
+        /*
+         build acceleration structures etc.
+         BVH_SPLIT::SPATIAL clips triangles to split planes and may reference triangles from more than one
+         leaf (up to _fMaxDuplication extra references, as a fraction of the triangle count).
+         */
+        void buildBvh(BASE::BVH_SPLIT _split = BASE::BVH_SPLIT::SAH, float _fMaxDuplication = BASE::BVH_MAX_DUPLICATION, int _iThreads = CORE::hardwareThreads()) {
+            if (_split == BASE::BVH_SPLIT::SPATIAL) {
+                m_bvh.buildSpatial(getTrianglePtrs(), MAX_LEAF_TRIANGLES, _fMaxDuplication, [this](uint32_t _uIndex, const CORE::Bounds &_box){
+                    const auto &t = m_triangles[_uIndex];
+                    return clipTriangleBounds(m_vertices[t.m_v[0]].m_v, m_vertices[t.m_v[1]].m_v, m_vertices[t.m_v[2]].m_v, _box);
+                });
+            }
+            else {
+                m_bvh.build(getTrianglePtrs(), _split, MAX_LEAF_TRIANGLES, _iThreads);
+            }
+            
+            m_bvh.reorder(m_triangles);     // store triangles in leaf order (duplicated for spatial splits)
+            buildTrianglePackets();
         }
-
-     protected:
-        // returns index of triangle in mesh
-        int32_t getIndex(const MeshTriangle *_pTriangle) const {
-            return (int32_t)(_pTriangle - m_triangles.data());
+        
+        /* returns BVH build stats */
+        const BASE::BvhBuildStats &bvhStats() const {
+            return m_bvh.stats();
         }
         
-        MeshIntersect getMeshIntersect(const MeshTriangle *_pTriangle, const CORE::Ray &_ray) const {
-            const auto &v0 = m_vertices[_pTriangle->m_v[0]];
-            const auto &v1 = m_vertices[_pTriangle->m_v[1]];
-            const auto &v2 = m_vertices[_pTriangle->m_v[2]];
-
-            MeshIntersect mi = triangleIntersect(_ray, v0.m_v, v1.m_v, v2.m_v);
-            if (mi.m_fPositionOnRay >= 0) {
-                mi.m_iTriangleIndex = getIndex(_pTriangle);
+        /* returns true if the mesh has any triangles */
+        bool hasTriangles() const {
+            return (m_triangles.empty() == false) || (m_clusters.empty() == false);
+        }
+        
+        /* returns true if the mesh uses compact storage */
+        bool isCompact() const {
+            return m_bCompact;
+        }
+        
+        /* returns memory used by geometry and BVH (bytes) */
+        size_t memoryUsage() const {
+            auto bytes = [](const auto &_items) {
+                return _items.size() * sizeof(typename std::decay_t<decltype(_items)>::value_type);
+            };
+            
+            return bytes(m_vertices) + bytes(m_triangles) + bytes(m_packets) +
+                   bytes(m_compactNormals) + bytes(m_compactUvs) + bytes(m_clusters) + bytes(m_indices16) + bytes(m_indices32) +
+                   bytes(m_bvh.nodes()) + bytes(m_bvh.wideNodes()) + bytes(m_bvh.indices());
+        }
+        
+        /*
+         Switch to compact storage (once the BVH is built).
+         Drops vertex positions and triangle bounds (hit tests only use the triangle packets), stores normals
+         octahedral encoded in 32 bits and uvs as half floats. With _bClusterIndices, vertex indices are stored as
+         16-bit offsets from a base vertex per cluster of triangles (clusters spanning more vertices keep 32-bit indices).
+         NOTE: half float uvs lose precision for large (tiled) coordinates. Compact meshes can not be rebuilt or cached.
+         Returns the number of bytes saved.
+         */
+        size_t compact(bool _bClusterIndices = true) {
+            if ( (m_bCompact == true) || (hasTriangles() == false) ) {
+                return 0;
+            }
+            
+            const size_t before = memoryUsage();
+            
+            m_compactUvs.resize(m_vertices.size());
+            for (size_t i = 0; i < m_vertices.size(); i++) {
+                m_compactUvs[i] = CORE::packHalfUv(m_vertices[i].m_uv);
+            }
+            
+            // vertex normals, or triangle normals if vertex normals are not used
+            if (m_bUseVertexNormals == true) {
+                m_compactNormals.resize(m_vertices.size());
+                for (size_t i = 0; i < m_vertices.size(); i++) {
+                    m_compactNormals[i] = CORE::octEncode(m_vertices[i].m_normal);
+                }
+            }
+            else {
+                m_compactNormals.resize(m_triangles.size());
+                for (size_t i = 0; i < m_triangles.size(); i++) {
+                    m_compactNormals[i] = CORE::octEncode(m_triangles[i].m_normal);
+                }
             }
             
-            return mi;
+            // index clusters (triangles are in leaf order, so clusters are spatially coherent)
+            for (size_t first = 0; first < m_triangles.size(); first += CLUSTER_TRIANGLES) {
+                const size_t end = std::min(first + CLUSTER_TRIANGLES, m_triangles.size());
+                uint32_t minVertex = UINT32_MAX;
+                uint32_t maxVertex = 0;
+                for (size_t i = first; i < end; i++) {
+                    for (uint32_t v : m_triangles[i].m_v) {
+                        minVertex = std::min(minVertex, v);
+                        maxVertex = std::max(maxVertex, v);
+                    }
+                }
+                
+                MeshCluster cluster;
+                if ( (_bClusterIndices == true) && (maxVertex - minVertex <= 0xffff) ) {
+                    cluster.m_uBaseVertex = minVertex;
+                    cluster.m_uOffset = (uint32_t)m_indices16.size();
+                    for (size_t i = first; i < end; i++) {
+                        for (uint32_t v : m_triangles[i].m_v) {
+                            m_indices16.push_back((uint16_t)(v - minVertex));
+                        }
+                    }
+                }
+                else {
+                    cluster.m_uOffset = (uint32_t)m_indices32.size() | MeshCluster::WIDE;
+                    for (size_t i = first; i < end; i++) {
+                        m_indices32.insert(m_indices32.end(), m_triangles[i].m_v, m_triangles[i].m_v + 3);
+                    }
+                }
+                
+                m_clusters.push_back(cluster);
+            }
+            
+            m_indices16.shrink_to_fit();
+            m_indices32.shrink_to_fit();
+            std::vector<MeshVertex>().swap(m_vertices);
+            std::vector<MeshTriangle>().swap(m_triangles);
+            m_bCompact = true;
+            
+            return before - memoryUsage();
+        }
+
+        /* store triangles (in leaf order) as SoA packets (first vertex and edges) for SIMD hit tests */
+        void buildTrianglePackets() {
+            m_packets.assign((m_triangles.size() + TRIANGLE_PACKET_SIZE - 1) / TRIANGLE_PACKET_SIZE, TrianglePacket());
+            for (size_t i = 0; i < m_triangles.size(); i++) {
+                const auto &t = m_triangles[i];
+                m_packets[i / TRIANGLE_PACKET_SIZE].set((int)(i % TRIANGLE_PACKET_SIZE),
+                                                        m_vertices[t.m_v[0]].m_v, m_vertices[t.m_v[1]].m_v, m_vertices[t.m_v[2]].m_v);
+            }
         }
         
+     protected:
         // get list of triangles (raw pointers)
         std::vector<const MeshTriangle*> getTrianglePtrs() const {
             std::vector<const MeshTriangle*> trianglePtrs;
@@ -341,6 +551,35 @@ namespace DETAIL
             return trianglePtrs;
         }
 
+     private:
+        // vertex indices of triangle
+        std::array<uint32_t, 3> triangleVertices(uint32_t _uTriangle) const {
+            if (m_bCompact == false) {
+                const auto &t = m_triangles[_uTriangle];
+                return {t.m_v[0], t.m_v[1], t.m_v[2]};
+            }
+            
+            const auto &cluster = m_clusters[_uTriangle / CLUSTER_TRIANGLES];
+            const uint32_t k = (cluster.m_uOffset & ~MeshCluster::WIDE) + (_uTriangle % CLUSTER_TRIANGLES) * 3;
+            if ((cluster.m_uOffset & MeshCluster::WIDE) != 0) {
+                return {m_indices32[k], m_indices32[k + 1], m_indices32[k + 2]};
+            }
+            
+            return {cluster.m_uBaseVertex + m_indices16[k], cluster.m_uBaseVertex + m_indices16[k + 1], cluster.m_uBaseVertex + m_indices16[k + 2]};
+        }
+        
+        CORE::Vec vertexNormal(uint32_t _uVertex) const {
+            return m_bCompact ? CORE::octDecode(m_compactNormals[_uVertex]) : m_vertices[_uVertex].m_normal;
+        }
+        
+        CORE::Vec triangleNormal(uint32_t _uTriangle) const {
+            return m_bCompact ? CORE::octDecode(m_compactNormals[_uTriangle]) : m_triangles[_uTriangle].m_normal;
+        }
+        
+        CORE::Uv vertexUv(uint32_t _uVertex) const {
+            return m_bCompact ? CORE::unpackHalfUv(m_compactUvs[_uVertex]) : m_vertices[_uVertex].m_uv;
+        }
+        
      private:
         std::vector<MeshVertex> m_vertices;
         std::vector<MeshTriangle> m_triangles;
@@ -348,8 +587,16 @@ namespace DETAIL
         const BASE::Material *m_pMaterial;
         bool m_bBoundsInit;
         bool m_bUseVertexNormals;
-        BASE::BvhNode<MeshTriangle> *m_pBvhRoot;
-        std::vector<std::unique_ptr<BASE::BvhNode<MeshTriangle>>> m_memory;
+        BASE::FlatBvh<MeshTriangle> m_bvh;
+        std::vector<TrianglePacket> m_packets;
+        
+        // compact storage
+        bool m_bCompact;
+        std::vector<uint32_t> m_compactNormals;     // octahedral vertex normals (triangle normals without vertex normals)
+        std::vector<uint32_t> m_compactUvs;         // half float vertex uvs
+        std::vector<MeshCluster> m_clusters;        // per CLUSTER_TRIANGLES triangles
+        std::vector<uint16_t> m_indices16;
+        std::vector<uint32_t> m_indices32;
     };
 
 
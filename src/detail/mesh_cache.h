@@ -0,0 +1,232 @@
+#pragma once
+
+#include "core/hash.h"
+#include "core/mapped_file.h"
+#include "core/vec3.h"
+#include "base/bvh.h"
+#include "mesh.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+namespace DETAIL
+{
+    /*
+     Binary cache of built meshes (vertices, triangles and BVH nodes).
+     File layout: header, followed by the vertex, triangle, node, wide node and index arrays, each
+     starting at an aligned offset. Cache files are only accepted for the same format version, key
+     (hash of source file and build settings) and struct layouts, and if all vertex, node and primitive
+     references are in range, otherwise the mesh has to be rebuilt.
+     Files are memory mapped on load and the arrays are copied into the mesh (Mesh and FlatBvh own their
+     storage), which skips the import and build but not the allocation.
+     */
+    class MeshCache
+    {
+     public:
+        static constexpr uint32_t VERSION = 1;
+
+        /* cache key from the source file contents and a hash of the build settings; returns 0 if the source can not be read */
+        static uint64_t key(const std::string &_strSourcePath, uint64_t _uSettingsHash) {
+            CORE::MappedFile source(_strSourcePath);
+            if (source.isOpen() == false) {
+                return 0;
+            }
+
+            uint64_t hash = CORE::hashValue(VERSION, _uSettingsHash);
+            return CORE::hashBytes(source.data(), source.size(), hash);
+        }
+
+        /* write mesh to cache file (written to a temporary file first and then renamed); compact meshes are not cached */
+        static bool save(const Mesh &_mesh, const std::string &_strPath, uint64_t _uKey) {
+            if (_mesh.m_bCompact == true) {
+                return false;
+            }
+            
+            const auto &bvh = _mesh.m_bvh;
+
+            Header header;
+            header.m_uKey = _uKey;
+            header.m_uFlags = _mesh.m_bUseVertexNormals ? FLAG_VERTEX_NORMALS : 0;
+            header.m_uCounts[VERTICES] = _mesh.m_vertices.size();
+            header.m_uCounts[TRIANGLES] = _mesh.m_triangles.size();
+            header.m_uCounts[NODES] = bvh.nodes().size();
+            header.m_uCounts[WIDE_NODES] = bvh.wideNodes().size();
+            header.m_uCounts[INDICES] = bvh.indices().size();
+            header.m_bounds = _mesh.m_bounds;
+            header.m_stats = bvh.stats();
+
+            const std::string strTmpPath = _strPath + ".tmp";
+            std::ofstream file(strTmpPath, std::ios::binary | std::ios::trunc);
+            if (file.is_open() == false) {
+                return false;
+            }
+
+            size_t offset = 0;
+            auto write = [&](const void *_pData, size_t _uSize) {
+                static const char padding[ALIGNMENT] = {};
+                file.write(padding, alignedSize(offset) - offset);
+                file.write(static_cast<const char*>(_pData), _uSize);
+                offset = alignedSize(offset) + _uSize;
+            };
+
+            write(&header, sizeof(header));
+            write(_mesh.m_vertices.data(), _mesh.m_vertices.size() * sizeof(MeshVertex));
+            write(_mesh.m_triangles.data(), _mesh.m_triangles.size() * sizeof(MeshTriangle));
+            write(bvh.nodes().data(), bvh.nodes().size() * sizeof(BASE::BvhFlatNode));
+            write(bvh.wideNodes().data(), bvh.wideNodes().size() * sizeof(WideNode));
+            write(bvh.indices().data(), bvh.indices().size() * sizeof(uint32_t));
+
+            file.close();
+            if (file.fail() == true) {
+                std::remove(strTmpPath.c_str());
+                return false;
+            }
+
+            return std::rename(strTmpPath.c_str(), _strPath.c_str()) == 0;
+        }
+
+        /* load mesh from cache file; returns false (and leaves mesh unchanged) if there is no valid cache for the key */
+        static bool load(Mesh &_mesh, const std::string &_strPath, uint64_t _uKey) {
+            CORE::MappedFile file(_strPath);
+            if ( (file.isOpen() == false) || (file.size() < sizeof(Header)) ) {
+                return false;
+            }
+
+            Header header;
+            std::memcpy(&header, file.data(), sizeof(Header));
+            if ( (header.m_uMagic != Header().m_uMagic) ||
+                 (header.m_uVersion != VERSION) ||
+                 (header.m_uKey != _uKey) ||
+                 (std::memcmp(header.m_uLayout, Header().m_uLayout, sizeof(header.m_uLayout)) != 0) )
+            {
+                return false;
+            }
+
+            size_t offset = sizeof(Header);
+            bool bValid = true;
+            auto read = [&](auto &_items, size_t _uCount) {
+                using item_type = typename std::decay_t<decltype(_items)>::value_type;
+                offset = alignedSize(offset);
+                if ( (bValid == false) || (_uCount > (file.size() - std::min(offset, file.size())) / sizeof(item_type)) ) {
+                    bValid = false;
+                    return;
+                }
+
+                _items.resize(_uCount);
+                std::memcpy((void*)_items.data(), file.data() + offset, _uCount * sizeof(item_type));
+                offset += _uCount * sizeof(item_type);
+            };
+
+            std::vector<MeshVertex> vertices;
+            std::vector<MeshTriangle> triangles;
+            std::vector<BASE::BvhFlatNode> nodes;
+            std::vector<WideNode> wideNodes;
+            std::vector<uint32_t> indices;
+
+            read(vertices, header.m_uCounts[VERTICES]);
+            read(triangles, header.m_uCounts[TRIANGLES]);
+            read(nodes, header.m_uCounts[NODES]);
+            read(wideNodes, header.m_uCounts[WIDE_NODES]);
+            read(indices, header.m_uCounts[INDICES]);
+            if ( (bValid == false) || (validate(vertices, triangles, nodes, wideNodes, indices) == false) ) {
+                return false;
+            }
+
+            _mesh.m_vertices = std::move(vertices);
+            _mesh.m_triangles = std::move(triangles);
+            _mesh.m_bounds = header.m_bounds;
+            _mesh.m_bBoundsInit = true;
+            _mesh.m_bUseVertexNormals = (header.m_uFlags & FLAG_VERTEX_NORMALS) != 0;
+            _mesh.m_bvh.assign(std::move(nodes), std::move(wideNodes), std::move(indices), header.m_stats);
+            _mesh.buildTrianglePackets();
+            return true;
+        }
+
+     private:
+        using WideNode = BASE::BvhWideNode<CORE::SIMD_WIDTH>;
+
+        static constexpr size_t ALIGNMENT = 64;
+        static constexpr uint32_t FLAG_VERTEX_NORMALS = 1;
+        enum ARRAY {VERTICES = 0, TRIANGLES, NODES, WIDE_NODES, INDICES, ARRAY_COUNT};
+
+        struct Header
+        {
+            uint32_t                m_uMagic = 0x4348534D;    // "MSHC" as stored in little endian byte order
+            uint32_t                m_uVersion = VERSION;
+            uint64_t                m_uKey = 0;
+            uint32_t                m_uLayout[5] = {sizeof(MeshVertex), sizeof(MeshTriangle), sizeof(BASE::BvhFlatNode), sizeof(WideNode), CORE::SIMD_WIDTH};
+            uint32_t                m_uFlags = 0;
+            uint64_t                m_uCounts[ARRAY_COUNT] = {};
+            CORE::Bounds            m_bounds;
+            BASE::BvhBuildStats     m_stats;
+        };
+
+        /*
+         Check that triangles only reference existing vertices, and nodes only existing nodes (after themselves,
+         so traversal can not loop) and index ranges, and indices only existing triangles.
+         */
+        static bool validate(const std::vector<MeshVertex> &_vertices, const std::vector<MeshTriangle> &_triangles,
+                             const std::vector<BASE::BvhFlatNode> &_nodes, const std::vector<WideNode> &_wideNodes,
+                             const std::vector<uint32_t> &_indices)
+        {
+            if ( (_triangles.empty() == false) && ((_nodes.empty() == true) || (_wideNodes.empty() == true)) ) {
+                return false;
+            }
+            
+            for (const auto &triangle : _triangles) {
+                for (uint32_t v : triangle.m_v) {
+                    if (v >= _vertices.size()) {
+                        return false;
+                    }
+                }
+            }
+            
+            for (size_t i = 0; i < _nodes.size(); i++) {
+                const auto &node = _nodes[i];
+                if (node.isLeaf() == true) {
+                    if ((uint64_t)node.m_uOffset + node.m_uCount > _indices.size()) {
+                        return false;
+                    }
+                }
+                else if ( (i + 1 >= _nodes.size()) || (node.m_uOffset <= i) || (node.m_uOffset >= _nodes.size()) ) {
+                    return false;
+                }
+            }
+            
+            for (size_t i = 0; i < _wideNodes.size(); i++) {
+                const auto &node = _wideNodes[i];
+                if ( (node.m_uChildren == 0) || (node.m_uChildren > CORE::SIMD_WIDTH) ) {
+                    return false;
+                }
+                
+                for (uint32_t c = 0; c < node.m_uChildren; c++) {
+                    if (node.m_uCount[c] > 0) {
+                        if ((uint64_t)node.m_uChild[c] + node.m_uCount[c] > _indices.size()) {
+                            return false;
+                        }
+                    }
+                    else if ( (node.m_uChild[c] <= i) || (node.m_uChild[c] >= _wideNodes.size()) ) {
+                        return false;
+                    }
+                }
+            }
+            
+            for (uint32_t index : _indices) {
+                if (index >= _triangles.size()) {
+                    return false;
+                }
+            }
+            
+            return true;
+        }
+        
+        static size_t alignedSize(size_t _uSize) {
+            return (_uSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+    };
+
+};  // namespace DETAIL
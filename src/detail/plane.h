@@ -120,8 +120,8 @@ namespace DETAIL
             if (Plane::hit(_hit) == true) {
                 // check rectangle bounds
                 _hit.m_position = _hit.m_priRay.position(_hit.m_fPositionOnRay);
-                return (fabs(_hit.m_position.x()) <= m_fWidth) &&
-                       (fabs(_hit.m_position.z()) <= m_fLength);
+                return (fabs(_hit.m_position.x()) <= m_fWidth * 0.5f) &&
+                       (fabs(_hit.m_position.z()) <= m_fLength * 0.5f);
             }
             
             return false;
@@ -139,6 +139,26 @@ namespace DETAIL
         virtual const CORE::Bounds &bounds() const override {
             return  m_bounds;
         }
+        
+        /* Samples a point on the surface (uniform by area; the rectangle is only visible from above). */
+        virtual bool sampleSurface(BASE::SurfaceSample &_sample, const CORE::Vec &) const override {
+            if (m_fWidth * m_fLength <= 0) {
+                return false;
+            }
+            
+            std::uniform_real_distribution<float> uniform(-0.5f, 0.5f);
+            auto &rgen = CORE::generator();
+            
+            _sample.m_position = CORE::Vec(uniform(rgen) * m_fWidth, 0, uniform(rgen) * m_fLength);
+            _sample.m_normal = CORE::Vec(0, 1, 0);
+            _sample.m_fPdf = surfacePdf(CORE::Vec(0, 0, 0), _sample.m_position);
+            return true;
+        }
+        
+        /* Probability density (per surface area) of sampleSurface() returning _position. */
+        virtual float surfacePdf(const CORE::Vec &, const CORE::Vec &) const override {
+            return m_fWidth * m_fLength > 0 ? 1.0f / (m_fWidth * m_fLength) : 0.0f;
+        }
 
      private:
         CORE::Bounds                m_bounds;
@@ -1,15 +1,18 @@
 #pragma once
 
 #include "base/bvh.h"
+#include "base/tlas.h"
 #include "core/color.h"
 #include "core/queue.h"
 #include "base/intersect.h"
 #include "base/primitive.h"
 #include "base/resource.h"
 
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <cassert>
+#include <thread>
 
 
 
@@ -44,11 +47,35 @@ namespace DETAIL
             return _hit;
         }
 
+        /* Checks for any hit on the ray closer than _fMaxDist. */
+        virtual bool occluded(const CORE::Ray &_ray, float _fMaxDist) const override {
+            CORE::Ray ray(_ray);
+            ray.m_fMaxDist = std::min(_fMaxDist, _ray.m_fMaxDist);
+            
+            for (const auto &pObj : m_objects) {
+                if (auto i = aaboxIntersect(pObj->bounds(), ray); (i.intersect() == true) && (pObj->occluded(ray) == true)) {
+                    return true;
+                }
+            }
+            
+            return false;
+        }
+        
         /*
-            Build scene (BVH, etc.).
+            Build scene (light list).
          */
         virtual void build() override {
-            // do nothing
+            buildLights();
+        }
+        
+        /* Samples a point on a light that may be visible from _from. */
+        virtual bool sampleLight(BASE::LightSample &_sample, const CORE::Vec &_from) const override {
+            return m_lights.sample(_sample, _from);
+        }
+        
+        /* Probability density (per surface area) of sampleLight() returning _position on _pLight. */
+        virtual float lightPdf(const BASE::PrimitiveInstance *_pLight, const CORE::Vec &_from, const CORE::Vec &_position) const override {
+            return m_lights.pdf(_pLight, _from, _position);
         }
 
         /*
@@ -77,10 +104,26 @@ namespace DETAIL
             return m_objects.back().get();
         }
         
+        /* returns the primitive instances of the scene */
+        const std::vector<std::unique_ptr<BASE::PrimitiveInstance>> &instances() const {
+            return m_objects;
+        }
+        
+        /* returns the number of lights (emissive instances, valid after build) */
+        size_t lightCount() const {
+            return m_lights.size();
+        }
+        
+     protected:
+        void buildLights() {
+            m_lights.build(m_objects);
+        }
+        
      protected:
         CORE::Color                                            m_backgroundColor;
         std::vector<std::unique_ptr<BASE::Resource>>           m_resources;
         std::vector<std::unique_ptr<BASE::PrimitiveInstance>>  m_objects;
+        BASE::LightList                                        m_lights;
     };
 
 
@@ -88,47 +131,75 @@ namespace DETAIL
     class SimpleSceneBvh   : public SimpleScene
     {
      public:
-        SimpleSceneBvh(const CORE::Color &_background)
-            :SimpleScene(_background)
+        SimpleSceneBvh(const CORE::Color &_background, BASE::BVH_SPLIT _split = BASE::BVH_SPLIT::SAH)
+            :SimpleScene(_background),
+             m_split(_split),
+             m_fRebuildCostRatio(2.0f)
         {}
             
         // Checks for an intersect with a scene object (could be accessed by multiple worker threads concurrently).
         virtual bool hit(BASE::Intersect &_hit) const override {
-            return checkBvhHit(_hit);
+            return m_tlas.hit(_hit);
+        }
+        
+        // Checks for any hit on the ray closer than _fMaxDist (TLAS and mesh BVHs stop on the first hit).
+        virtual bool occluded(const CORE::Ray &_ray, float _fMaxDist) const override {
+            CORE::Ray ray(_ray);
+            ray.m_fMaxDist = std::min(_fMaxDist, _ray.m_fMaxDist);
+            return m_tlas.occluded(ray);
+        }
+        
+        // Checks for intersects of a packet of rays (sharing one TLAS traversal).
+        virtual uint32_t hitPacket(BASE::Intersect *_pHits, uint32_t _uCount) const override {
+            return m_tlas.hitPacket(_pHits, _uCount);
         }
 
-        // Build acceleration structures
+        // Build acceleration structures (TLAS over instances; primitives build their own BLAS)
         virtual void build() override {
             std::vector<const BASE::PrimitiveInstance*> rawObjects(m_objects.size(), nullptr);
             for (size_t i = 0; i < m_objects.size(); i++) {
                 rawObjects[i] = m_objects[i].get();
             }
 
-            m_pBvhRoot = BASE::buildBvhRoot(rawObjects,
-                                            [&](){
-                                                 m_memory.push_back(std::make_unique<BASE::BvhNode<BASE::PrimitiveInstance>>());
-                                                 return m_memory.back().get();
-                                            });
+            m_tlas.build(rawObjects, m_split, (int)std::thread::hardware_concurrency());
+            buildLights();
         }
-
-     private:
-        // Search for best hit through BVHs (iterative)
-        bool checkBvhHit(BASE::Intersect &_hit) const
-        {
-            BASE::checkBvhHit(m_pBvhRoot, _hit.m_viewRay,
-                              [&](const BASE::PrimitiveInstance *_pPrimitive, const CORE::Ray _ray){
-                                if (BASE::Intersect nh(_hit); (_pPrimitive->hit(nh) == true) && ( (_hit == false) || (nh < _hit)) )
-                                {
-                                    _hit = nh;
-                                }
-                              });
-
-            return _hit;
+        
+        /*
+         Refit BVH bounds to moved instances. Rebuilds if instances were added since the last build, or
+         if the refitted tree cost grew past the rebuild ratio (relative to the cost after the last build).
+         */
+        virtual void refit() override {
+            if (m_tlas.size() != m_objects.size()) {
+                build();
+                return;
+            }
+            
+            float cost = m_tlas.refit();
+            if ( (m_fRebuildCostRatio > 0) && (cost > m_tlas.stats().m_fSahCost * m_fRebuildCostRatio) ) {
+                build();
+            }
+        }
+        
+        // set refitted/built tree cost ratio that triggers a rebuild (0 to never rebuild on refit)
+        void setRebuildCostRatio(float _fRatio) {
+            m_fRebuildCostRatio = _fRatio;
+        }
+        
+        // returns BVH build stats
+        const BASE::BvhBuildStats &bvhStats() const {
+            return m_tlas.stats();
+        }
+        
+        // returns number of distinct primitives (BLAS) referenced by the TLAS
+        size_t blasCount() const {
+            return m_tlas.blasCount();
         }
 
      private:
-        BASE::BvhNode<BASE::PrimitiveInstance> *m_pBvhRoot;
-        std::vector<std::unique_ptr<BASE::BvhNode<BASE::PrimitiveInstance>>> m_memory;
+        BASE::BVH_SPLIT m_split;
+        float           m_fRebuildCostRatio;
+        BASE::Tlas      m_tlas;
     };
 
 
@@ -45,9 +45,10 @@ namespace DETAIL
                     auto tdist = inside ? bi.m_tmax : (bi.m_tmax - bi.m_tmin);
                     auto rdist = distance();
 
-                    if (rdist < tdist) {
+                    auto t = inside ? rdist : (bi.m_tmin + rdist);
+                    if ( (rdist < tdist) && (t <= _hit.m_priRay.m_fMaxDist) ) {
                         _hit.m_bInside = true;
-                        _hit.m_fPositionOnRay = inside ? rdist : (bi.m_tmin + rdist);
+                        _hit.m_fPositionOnRay = t;
                         return true;
                     }
                 }
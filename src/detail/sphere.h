@@ -69,6 +69,58 @@ namespace DETAIL
         virtual const CORE::Bounds &bounds() const override {
             return  m_bounds;
         }
+        
+        /*
+         Samples a point on the surface that may be visible from _from.
+         Samples the cone of directions from _from to the sphere uniformly (uniform by area when _from is inside).
+         */
+        virtual bool sampleSurface(BASE::SurfaceSample &_sample, const CORE::Vec &_from) const override {
+            std::uniform_real_distribution<float> uniform01(0, 1.0f);
+            auto &rgen = CORE::generator();
+            
+            const float distSqr = _from.sizeSqr();
+            if (distSqr <= m_fRadiusSqr * 1.0001f) {
+                _sample.m_normal = CORE::randomOnUnitSphere();
+                _sample.m_position = _sample.m_normal * m_fRadius;
+                _sample.m_fPdf = surfacePdf(_from, _sample.m_position);
+                return true;
+            }
+            
+            // direction in cone around center direction
+            const float dist = sqrt(distSqr);
+            const float cosThetaMax = sqrt(std::max(0.0f, 1 - m_fRadiusSqr / distSqr));
+            const float cosTheta = 1 - uniform01(rgen) * (1 - cosThetaMax);
+            const float sinThetaSqr = std::max(0.0f, 1 - cosTheta * cosTheta);
+            const float phi = 2 * pif * uniform01(rgen);
+            
+            // angle between direction to _from and sampled point (seen from the center)
+            const float ds = dist * cosTheta - sqrt(std::max(0.0f, m_fRadiusSqr - distSqr * sinThetaSqr));
+            const float cosAlpha = clamp((distSqr + m_fRadiusSqr - ds * ds) / (2 * dist * m_fRadius), -1.0f, 1.0f);
+            const float sinAlpha = sqrt(std::max(0.0f, 1 - cosAlpha * cosAlpha));
+            
+            const CORE::Vec w = _from / dist;
+            const CORE::Vec u = (fabs(w.x()) > 0.9f ? crossProduct(w, CORE::Vec(0, 1, 0)) : crossProduct(w, CORE::Vec(1, 0, 0))).normalized();
+            const CORE::Vec v = crossProduct(w, u);
+            
+            _sample.m_normal = u * (sinAlpha * cos(phi)) + v * (sinAlpha * sin(phi)) + w * cosAlpha;
+            _sample.m_position = _sample.m_normal * m_fRadius;
+            _sample.m_fPdf = surfacePdf(_from, _sample.m_position);
+            return true;
+        }
+        
+        /* Probability density (per surface area) of sampleSurface() returning _position when sampling from _from. */
+        virtual float surfacePdf(const CORE::Vec &_from, const CORE::Vec &_position) const override {
+            const float distSqr = _from.sizeSqr();
+            if (distSqr <= m_fRadiusSqr * 1.0001f) {
+                return 1.0f / (4 * pif * m_fRadiusSqr);
+            }
+            
+            // solid angle pdf (uniform in cone) to area pdf
+            const float cosThetaMax = sqrt(std::max(0.0f, 1 - m_fRadiusSqr / distSqr));
+            const CORE::Vec toSample = _position - _from;
+            const float cosLight = fabs(_position * toSample) / (m_fRadius * toSample.size());
+            return cosLight / (2 * pif * (1 - cosThetaMax) * toSample.sizeSqr());
+        }
 
      private:
         const BASE::Material    *m_pMaterial;
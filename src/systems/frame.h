@@ -1,21 +1,28 @@
 
 #pragma once
 
+#include "core/accumulation.h"
 #include "core/constants.h"
 #include "core/image.h"
+#include "core/morton.h"
 #include "core/outputimage.h"
 #include "core/viewport.h"
 #include "core/ray.h"
 #include "core/random.h"
+#include "core/stats.h"
 #include "base/camera.h"
 #include "base/scene.h"
 #include "jobs.h"
 #include "trace.h"
+#include "wavefront.h"
 
 #include <algorithm>
+#include <array>
 #include <chrono>
+#include <memory>
 #include <random>
 #include <atomic>
+#include <vector>
 
 
 
@@ -33,6 +40,7 @@ namespace SYSTEMS
              m_fTotalJobProgress(0),
              m_uCompletedJobs(0),
              m_uRayCount(0),
+             m_uSampleCount(0),
              m_fTimeSpentS(0),
              m_fTimeToFinishS(0),
              m_fFrameProgress(0),
@@ -46,6 +54,16 @@ namespace SYSTEMS
             m_uJobCount = _uJobCount;
         }
         
+        // jobs added while running (split tiles)
+        void addJobs(size_t _uJobCount) {
+            m_uJobCount += _uJobCount;
+        }
+        
+        // jobs that will not run (progressive passes after a stop)
+        void removeJobs(size_t _uJobCount) {
+            m_uJobCount -= _uJobCount;
+        }
+        
         void setCompletedJobs(size_t _uCompletedJobs) {
             m_uCompletedJobs = _uCompletedJobs;
         }
@@ -57,6 +75,10 @@ namespace SYSTEMS
         void updateRayCount(uint64_t _uRayCountDelta) {
             m_uRayCount += _uRayCountDelta;
         }
+        
+        void updateSampleCount(uint64_t _uSampleCountDelta) {
+            m_uSampleCount += _uSampleCountDelta;
+        }
 
         // recalculate frame stats
         void update() {
@@ -99,6 +121,11 @@ namespace SYSTEMS
             return m_fRaysPerSecond;
         }
         
+        // number of pixel samples taken by completed jobs
+        uint64_t sampleCount() const {
+            return m_uSampleCount;
+        }
+        
         bool isFinished() const {
             return m_bFinished;
         }
@@ -108,11 +135,12 @@ namespace SYSTEMS
         clock_type::time_point                  m_tpStart;
         clock_type::time_point                  m_tpEnd;
         clock_type::time_point                  m_tpPerfCalc;
-        size_t                                  m_uJobCount;
         
+        std::atomic<size_t>                     m_uJobCount;
         std::atomic<float>                      m_fTotalJobProgress;
         std::atomic<size_t>                     m_uCompletedJobs;
         std::atomic<uint64_t>                   m_uRayCount;
+        std::atomic<uint64_t>                   m_uSampleCount;
 
         float                                   m_fTimeSpentS;
         float                                   m_fTimeToFinishS;
@@ -122,74 +150,156 @@ namespace SYSTEMS
     };
 
 
-    /* Raytracing job (line of pixels on output image) */
+    /* path integrator used by pixel jobs */
+    enum class INTEGRATOR {
+        PATH = 1,           // one path at a time, depth-first (RayTracer)
+        WAVEFRONT = 2,      // all paths of a job advanced one bounce at a time (WavefrontTracer)
+        SORTED = 3,         // wavefront, with secondary rays sorted by direction and origin before each bounce
+        LIGHTS = 4          // one path at a time, with light sampling combined with scattering (MIS, RayTracer)
+    };
+
+
+    /* Rectangle of pixels on the output image rendered by one job */
+    struct Tile
+    {
+        int     m_iX;
+        int     m_iY;
+        int     m_iWidth;
+        int     m_iHeight;
+        
+        int pixels() const {
+            return m_iWidth * m_iHeight;
+        }
+    };
+
+
+    /* order of tile jobs in the queue (space-filling curve over the tile grid) */
+    enum class TILE_ORDER {
+        HILBERT = 1,
+        MORTON = 2
+    };
+
+
+    /*
+     Progressive rendering state of a frame, shared by its pixel jobs: accumulated samples, number of passes
+     (and samples per pixel in each pass), pixels completed per pass and the stop flag.
+     With adaptive sampling, the luminance statistics of every pixel are kept across passes (only the job of the
+     tile containing the pixel accesses them, and passes of a tile run one after another).
+     */
+    struct FramePasses
+    {
+        FramePasses(int _iWidth, int _iHeight, int _iPasses, int _iPassSamples, bool _bAdaptive)
+            :m_accumulation(_iWidth, _iHeight),
+             m_luminance(_bAdaptive ? (size_t)_iWidth * _iHeight : 0),
+             m_iPasses(_iPasses),
+             m_iPassSamples(_iPassSamples),
+             m_passPixels(_iPasses),
+             m_bStopped(false)
+        {}
+        
+        // number of passes completed over the whole image
+        int completedPasses() const {
+            const uint64_t pixels = (uint64_t)m_accumulation.width() * m_accumulation.height();
+            int ret = 0;
+            while ( (ret < m_iPasses) && (m_passPixels[ret] == pixels) ) {
+                ret++;
+            }
+            
+            return ret;
+        }
+        
+        CORE::AccumulationBuffer                m_accumulation;
+        std::vector<CORE::RunningStat>          m_luminance;        // (adaptive sampling only)
+        int                                     m_iPasses;
+        int                                     m_iPassSamples;
+        std::vector<std::atomic<uint64_t>>      m_passPixels;
+        std::atomic<bool>                       m_bStopped;
+    };
+
+
+    /*
+     Raytracing job (tile of pixels on output image, a line by default)
+     Adaptive sampling (with _fAdaptiveThreshold > 0): after _iMinSamplesPerPixel samples, a pixel stops taking
+     samples once the 95% confidence interval of its mean luminance is within the threshold (relative to the mean),
+     or at _iMaxSamplesPerPixel. In progressive rendering the statistics span all passes, so converged pixels take
+     no samples in later passes. Not used by the wavefront integrators (they trace all samples at once).
+     Progressive rendering (with _pPasses): the job traces one pass of the tile into the accumulation buffer and
+     then pushes the job for the next pass of the tile to _pJobs, until the last pass or until the frame is stopped.
+     Tail splitting (with _iSplitQueueSize > 0): while fewer jobs than that are queued, the job spawns half of its
+     tile as a new job before running, so that the last jobs of a frame are stolen by idle workers.
+     */
     class PixelJob  : public Job
     {
+     protected:
+        const static int    MIN_TILE_SIZE       = 4;      // tail splitting stops at tiles of this size
+        
      public:
-        PixelJob(const CORE::OutputImageBuffer *_pImage, int _iLine,
+        PixelJob(const CORE::OutputImageBuffer *_pImage, const Tile &_tile,
                  const CORE::Viewport *_pViewport,
                  const BASE::Camera *_pCamera,
                  const BASE::Scene *_pScene,
                  FrameStats *_pFrameStats,
                  int _iMaxSamplesPerPixel,
-                 int _iMaxDepth)
+                 int _iMaxDepth,
+                 int _iRayPacketSize,
+                 INTEGRATOR _integrator,
+                 int _iMinSamplesPerPixel,
+                 float _fAdaptiveThreshold,
+                 JobQueue *_pJobs = nullptr,
+                 FramePasses *_pPasses = nullptr,
+                 int _iSplitQueueSize = 0)
             :m_pImage(_pImage),
              m_pViewport(_pViewport),
              m_pCamera(_pCamera),
              m_pScene(_pScene),
              m_pFrameStats(_pFrameStats),
-             m_iLine(_iLine),
+             m_pJobs(_pJobs),
+             m_pPasses(_pPasses),
+             m_tile(_tile),
+             m_iPass(0),
              m_iMaxSamplesPerPixel(_iMaxSamplesPerPixel),
              m_iMaxDepth(_iMaxDepth),
+             m_iRayPacketSize(std::min(_iRayPacketSize, (int)RayTracer::MAX_PACKET_SIZE)),
+             m_integrator(_integrator),
+             m_iMinSamplesPerPixel(std::max(_iMinSamplesPerPixel, 2)),     // (variance needs two samples)
+             m_fAdaptiveThreshold(_fAdaptiveThreshold),
+             m_iSplitQueueSize(_iSplitQueueSize),
              m_fProgress(0)
         {}
         
         // do the work -- blocks until completed
         virtual void run() override
         {
-            RayTracer tracer(m_pScene, (uint16_t)m_iMaxDepth);
-            const float fFovScale = tan(m_pCamera->fov() * 0.5f);
-            unsigned char *pPixel = (unsigned char *)m_pImage->row(m_iLine);
+            if ( (m_pPasses != nullptr) && (m_pPasses->m_bStopped == true) ) {
+                m_pFrameStats->removeJobs(remainingPasses());     // (following passes of the tile)
+                m_fProgress = 1.0f;
+                return;
+            }
             
-            // run through one line in output image
-            const float y = (1.0f - 2.0f * m_iLine / m_pViewport->height()) * fFovScale;
-
-            for (auto i = 0; i < m_pViewport->width(); i++)
-            {
-                const float x = (1.0f - 2.0f * i / m_pViewport->width()) * fFovScale * m_pViewport->viewAspect();
-                CORE::Color color;
-                int n = 0;
-                
-                for (int k = 0; k < m_iMaxSamplesPerPixel; k++)
-                {
-                    // calc origin in camera
-                    auto rayOrigin = CORE::randomInUnitDisc() * m_pCamera->aperture() * 0.5;
-                    
-                    // calc lookat point on focus plane
-                    auto rayFocus = (CORE::Vec(x, y, 1) + randomInPixel()) * m_pCamera->focusDistance();
-                    
-                    // create ray (transform from camera to world)
-                    rayOrigin = m_pCamera->axis().transformFrom(rayOrigin);
-                    rayFocus = m_pCamera->axis().transformFrom(rayFocus);
-                    auto ray = CORE::Ray(rayOrigin, (rayFocus - rayOrigin).normalized(), true);
-                    
-                    // trace ray
-                    color += tracer.trace(ray);
-                    n++;
+            if ( (m_iSplitQueueSize > 0) && ((int)m_pJobs->size() < m_iSplitQueueSize) ) {
+                splitTile();
+            }
+            
+            const int samples = samplesPerPixel();
+            m_colors.assign(m_tile.pixels(), CORE::Color(0, 0, 0));
+            m_samples.assign(m_tile.pixels(), 0);
+            
+            if ( (m_integrator == INTEGRATOR::WAVEFRONT) || (m_integrator == INTEGRATOR::SORTED) ) {
+                runWavefront(samples);
+            }
+            else {
+                RayTracer tracer(m_pScene, (uint16_t)m_iMaxDepth, m_integrator == INTEGRATOR::LIGHTS);
+                if (m_iRayPacketSize > 1) {
+                    runPackets(tracer, samples);
                 }
-                                
-                // get pixel color
-                color = (color/(float)n).clamp().gammaCorrect2();
-
-                // write to output image
-                *(pPixel++) = (unsigned char)(255 * color.red() + 0.5f);
-                *(pPixel++) = (unsigned char)(255 * color.green() + 0.5f);
-                *(pPixel++) = (unsigned char)(255 * color.blue() + 0.5f);
-                m_fProgress =  (float)i / m_pViewport->width();
+                else {
+                    runPixels(tracer, samples);
+                }
+                
+                m_pFrameStats->updateRayCount(tracer.rayCount());
             }
-
-            // update frame stats
-            m_pFrameStats->updateRayCount(tracer.rayCount());
+            
+            writeTile();
         }
 
         // returns progress [0..1] while the job is running
@@ -198,6 +308,234 @@ namespace SYSTEMS
         }
 
      private:
+        // job for another tile or pass
+        PixelJob(const PixelJob &_job, const Tile &_tile, int _iPass)
+            :PixelJob(_job.m_pImage, _tile, _job.m_pViewport, _job.m_pCamera, _job.m_pScene, _job.m_pFrameStats,
+                      _job.m_iMaxSamplesPerPixel, _job.m_iMaxDepth, _job.m_iRayPacketSize, _job.m_integrator,
+                      _job.m_iMinSamplesPerPixel, _job.m_fAdaptiveThreshold, _job.m_pJobs, _job.m_pPasses, _job.m_iSplitQueueSize)
+        {
+            m_iPass = _iPass;
+        }
+        
+        // samples per pixel in this job (all samples, or the samples of the pass)
+        int samplesPerPixel() const {
+            if (m_pPasses == nullptr) {
+                return std::max(m_iMaxSamplesPerPixel, 0);
+            }
+            
+            const int first = m_iPass * m_pPasses->m_iPassSamples;
+            return std::max(std::min(m_pPasses->m_iPassSamples, m_iMaxSamplesPerPixel - first), 0);
+        }
+        
+        // number of passes of the tile after this one
+        int remainingPasses() const {
+            return m_pPasses != nullptr ? m_pPasses->m_iPasses - m_iPass - 1 : 0;
+        }
+        
+        // tail splitting: spawn the second half of the tile (split across its longer side) as a new job
+        void splitTile() {
+            Tile tile = m_tile;
+            if ( (m_tile.m_iWidth >= m_tile.m_iHeight) && (m_tile.m_iWidth >= 2 * MIN_TILE_SIZE) ) {
+                m_tile.m_iWidth /= 2;
+                tile.m_iX += m_tile.m_iWidth;
+                tile.m_iWidth -= m_tile.m_iWidth;
+            }
+            else if (m_tile.m_iHeight >= 2 * MIN_TILE_SIZE) {
+                m_tile.m_iHeight /= 2;
+                tile.m_iY += m_tile.m_iHeight;
+                tile.m_iHeight -= m_tile.m_iHeight;
+            }
+            else {
+                return;
+            }
+            
+            m_pFrameStats->addJobs(remainingPasses() + 1);
+            m_pJobs->spawn(std::unique_ptr<Job>(new PixelJob(*this, tile, m_iPass)));
+        }
+        
+        // run through the pixels of the tile, one pixel at a time
+        void runPixels(RayTracer &_tracer, int _iSamples) {
+            for (int j = 0; j < m_tile.m_iHeight; j++) {
+                for (int i = 0; i < m_tile.m_iWidth; i++)
+                {
+                    const int index = j * m_tile.m_iWidth + i;
+                    CORE::RunningStat pixelLuminance;
+                    auto &luminance = luminanceStat(m_tile.m_iX + i, m_tile.m_iY + j, pixelLuminance);
+                    for (int k = 0; (k < _iSamples) && (converged(luminance) == false); k++)
+                    {
+                        // trace ray
+                        const auto sample = _tracer.trace(cameraRay(m_tile.m_iX + i, m_tile.m_iY + j));
+                        m_colors[index] += sample;
+                        m_samples[index]++;
+                        
+                        if (m_fAdaptiveThreshold > 0) {
+                            luminance.push(sample.luminance());
+                        }
+                    }
+                    
+                    m_fProgress =  (float)index / m_tile.pixels();
+                }
+            }
+        }
+        
+        // trace all samples of the tile together (wavefront, the paths are the deferred ray queue of the worker)
+        void runWavefront(int _iSamples) {
+            WavefrontTracer tracer(m_pScene, (uint16_t)m_iMaxDepth, (uint32_t)std::max(m_iRayPacketSize, 1), m_integrator == INTEGRATOR::SORTED);
+            std::vector<CORE::Ray> rays;
+            std::vector<uint32_t> pixels;
+            rays.reserve((size_t)m_tile.pixels() * _iSamples);
+            pixels.reserve((size_t)m_tile.pixels() * _iSamples);
+            
+            // generate samples in pixel order, so that neighbouring paths are coherent
+            for (int j = 0; j < m_tile.m_iHeight; j++) {
+                for (int i = 0; i < m_tile.m_iWidth; i++) {
+                    const int index = j * m_tile.m_iWidth + i;
+                    for (int k = 0; k < _iSamples; k++) {
+                        rays.push_back(cameraRay(m_tile.m_iX + i, m_tile.m_iY + j));
+                        pixels.push_back((uint32_t)index);
+                    }
+                    
+                    m_samples[index] = _iSamples;
+                }
+            }
+            
+            tracer.trace(rays, pixels, m_colors.data());
+            m_pFrameStats->updateRayCount(tracer.rayCount());
+        }
+        
+        // trace the tile in packets of primary rays through neighbouring pixels in a row (one sample per pixel per packet)
+        void runPackets(RayTracer &_tracer, int _iSamples) {
+            constexpr uint32_t N = RayTracer::MAX_PACKET_SIZE;
+            std::array<CORE::Ray, N> rays;
+            std::array<CORE::Color, N> traced;
+            std::array<CORE::RunningStat, N> packetLuminance;
+            std::array<CORE::RunningStat*, N> luminance;
+            std::array<int, N> active;      // pixels (in packet) of the traced rays
+            
+            for (int j = 0; j < m_tile.m_iHeight; j++) {
+                for (int first = 0; first < m_tile.m_iWidth; first += m_iRayPacketSize) {
+                    const int count = std::min(m_iRayPacketSize, m_tile.m_iWidth - first);
+                    const int index = j * m_tile.m_iWidth + first;
+                    for (int i = 0; i < count; i++) {
+                        packetLuminance[i] = CORE::RunningStat();
+                        luminance[i] = &luminanceStat(m_tile.m_iX + first + i, m_tile.m_iY + j, packetLuminance[i]);
+                    }
+                    
+                    
+                    for (int k = 0; k < _iSamples; k++) {
+                        // packet of the pixels that need more samples
+                        int n = 0;
+                        for (int i = 0; i < count; i++) {
+                            if (converged(*luminance[i]) == false) {
+                                active[n] = i;
+                                rays[n++] = cameraRay(m_tile.m_iX + first + i, m_tile.m_iY + j);
+                            }
+                        }
+                        
+                        if (n == 0) {
+                            break;
+                        }
+                        
+                        _tracer.tracePacket(rays.data(), traced.data(), (uint32_t)n);
+                        for (int p = 0; p < n; p++) {
+                            const int i = active[p];
+                            m_colors[index + i] += traced[p];
+                            m_samples[index + i]++;
+                            
+                            if (m_fAdaptiveThreshold > 0) {
+                                luminance[i]->push(traced[p].luminance());
+                            }
+                        }
+                    }
+                    
+                    m_fProgress = (float)(index + count) / m_tile.pixels();
+                }
+            }
+        }
+        
+        // write averaged colors to output image, or add the pass to the accumulation buffer and push the next pass
+        void writeTile() {
+            uint64_t sampleCount = 0;
+            for (int n : m_samples) {
+                sampleCount += n;
+            }
+            
+            m_pFrameStats->updateSampleCount(sampleCount);
+            
+            if (m_pPasses == nullptr) {
+                for (int j = 0; j < m_tile.m_iHeight; j++) {
+                    unsigned char *pPixel = (unsigned char *)m_pImage->row(m_tile.m_iY + j) + 3 * m_tile.m_iX;
+                    for (int i = 0; i < m_tile.m_iWidth; i++) {
+                        const int index = j * m_tile.m_iWidth + i;
+                        writePixel(pPixel, m_colors[index] / (float)std::max(m_samples[index], 1));
+                    }
+                }
+            }
+            else {
+                m_pPasses->m_accumulation.addRect(m_tile.m_iX, m_tile.m_iY, m_tile.m_iWidth, m_tile.m_iHeight,
+                                                  m_iPass % 2, m_colors.data(), m_samples.data());
+                m_pPasses->m_passPixels[m_iPass] += m_tile.pixels();
+                
+                if (remainingPasses() > 0) {
+                    if (m_pPasses->m_bStopped == false) {
+                        m_pJobs->push(std::unique_ptr<Job>(new PixelJob(*this, m_tile, m_iPass + 1)));
+                    }
+                    else {
+                        m_pFrameStats->removeJobs(remainingPasses());
+                    }
+                }
+            }
+            
+            m_fProgress = 1.0f;
+        }
+        
+        // luminance statistics of a pixel: kept across passes in progressive rendering, otherwise _local (of this job)
+        CORE::RunningStat &luminanceStat(int _iX, int _iY, CORE::RunningStat &_local) const {
+            if ( (m_pPasses != nullptr) && (m_pPasses->m_luminance.empty() == false) ) {
+                return m_pPasses->m_luminance[(size_t)_iY * m_pPasses->m_accumulation.width() + _iX];
+            }
+            
+            return _local;
+        }
+        
+        // adaptive sampling: true once the confidence interval of the mean luminance is within the threshold
+        bool converged(const CORE::RunningStat &_luminance) const {
+            constexpr double Z95 = 1.96;                // 95% confidence
+            constexpr double MIN_LUMINANCE = 0.01;      // (dark pixels are compared to this)
+            
+            if ( (m_fAdaptiveThreshold <= 0) || ((int)_luminance.count() < m_iMinSamplesPerPixel) ) {
+                return false;
+            }
+            
+            return Z95 * _luminance.standardError() <= m_fAdaptiveThreshold * std::max(_luminance.mean(), MIN_LUMINANCE);
+        }
+        
+        // random camera ray through pixel
+        CORE::Ray cameraRay(int _iPixel, int _iLine) const {
+            const float fFovScale = tan(m_pCamera->fov() * 0.5f);
+            const float y = (1.0f - 2.0f * _iLine / m_pViewport->height()) * fFovScale;
+            const float x = (1.0f - 2.0f * _iPixel / m_pViewport->width()) * fFovScale * m_pViewport->viewAspect();
+            
+            // calc origin in camera
+            auto rayOrigin = CORE::randomInUnitDisc() * m_pCamera->aperture() * 0.5;
+            
+            // calc lookat point on focus plane
+            auto rayFocus = (CORE::Vec(x, y, 1) + randomInPixel()) * m_pCamera->focusDistance();
+            
+            // create ray (transform from camera to world)
+            rayOrigin = m_pCamera->axis().transformFrom(rayOrigin);
+            rayFocus = m_pCamera->axis().transformFrom(rayFocus);
+            return CORE::Ray(rayOrigin, (rayFocus - rayOrigin).normalized(), true);
+        }
+        
+        // write (averaged) color to output image
+        static void writePixel(unsigned char *&_pPixel, const CORE::Color &_color) {
+            auto color = CORE::Color(_color).clamp().gammaCorrect2();
+            *(_pPixel++) = (unsigned char)(255 * color.red() + 0.5f);
+            *(_pPixel++) = (unsigned char)(255 * color.green() + 0.5f);
+            *(_pPixel++) = (unsigned char)(255 * color.blue() + 0.5f);
+        }
+        
         CORE::Vec randomInPixel() const {
             CORE::Vec ret = CORE::randomInUnitSquare();
             ret.x() *= 0.5f / m_pViewport->width();
@@ -211,9 +549,19 @@ namespace SYSTEMS
         const BASE::Camera             *m_pCamera;
         const BASE::Scene              *m_pScene;
         FrameStats                     *m_pFrameStats;
-        int                            m_iLine;
+        JobQueue                       *m_pJobs;              // (jobs of following passes and split tiles are pushed here)
+        FramePasses                    *m_pPasses;            // (nullptr renders all samples in one job)
+        Tile                           m_tile;
+        int                            m_iPass;
         int                            m_iMaxSamplesPerPixel;
         int                            m_iMaxDepth;
+        int                            m_iRayPacketSize;      // primary rays per packet (0 or 1 traces single rays)
+        INTEGRATOR                     m_integrator;
+        int                            m_iMinSamplesPerPixel;
+        float                          m_fAdaptiveThreshold;  // relative confidence interval of pixel luminance (0 disables adaptive sampling)
+        int                            m_iSplitQueueSize;
+        std::vector<CORE::Color>       m_colors;              // color sums and sample counts of the pixels in the tile
+        std::vector<int>               m_samples;
         std::atomic<float>             m_fProgress;
     };
 
@@ -252,7 +600,14 @@ namespace SYSTEMS
               int _iNumWorkers,
               int _iMaxSamplesPerPixel,
               int _iMaxTraceDepth,
-              uint32_t _uRandSeed)
+              uint32_t _uRandSeed,
+              int _iRayPacketSize = 0,
+              INTEGRATOR _integrator = INTEGRATOR::PATH,
+              int _iMinSamplesPerPixel = 0,
+              float _fAdaptiveThreshold = 0.0f,
+              int _iPassSamplesPerPixel = 0,
+              int _iTileSize = 0,
+              TILE_ORDER _tileOrder = TILE_ORDER::HILBERT)
             :m_viewport(_iWidth, _iHeight),
              m_pCamera(_pCamera),
              m_pScene(_pScene),
@@ -260,10 +615,21 @@ namespace SYSTEMS
              m_iMaxSamplesPerPixel(_iMaxSamplesPerPixel),
              m_iNumWorkers(_iNumWorkers),
              m_iMaxTraceDepth(_iMaxTraceDepth),
+             m_iRayPacketSize(_iRayPacketSize),
+             m_integrator(_integrator),
+             m_iMinSamplesPerPixel(_iMinSamplesPerPixel),
+             m_fAdaptiveThreshold(_fAdaptiveThreshold),
+             m_iTileSize(_iTileSize),
+             m_tileOrder(_tileOrder),
              m_uRandomSeed(_uRandSeed)
         {
             CORE::generator().seed(m_uRandomSeed);
 
+            if (_iPassSamplesPerPixel > 0) {
+                const int passes = std::max((m_iMaxSamplesPerPixel + _iPassSamplesPerPixel - 1) / _iPassSamplesPerPixel, 1);
+                m_pPasses = std::make_unique<FramePasses>(_iWidth, _iHeight, passes, _iPassSamplesPerPixel, m_fAdaptiveThreshold > 0);
+            }
+            
             createJobs();
             createWorkers();
         }
@@ -312,13 +678,57 @@ namespace SYSTEMS
             return m_frameStats.raysPerSecond();
         }
         
+        // average samples per pixel taken by completed jobs
+        float samplesPerPixel() const {
+            return (float)m_frameStats.sampleCount() / (m_image.width() * m_image.height());
+        }
+        
         bool isFinished() const {
             return m_frameStats.isFinished();
         }
         
+        /*
+         Progressive rendering (frame created with samples per pass): stop after the passes that are running,
+         the frame finishes once they are done.
+         */
+        void stop() {
+            if (m_pPasses != nullptr) {
+                m_pPasses->m_bStopped = true;
+            }
+        }
+        
+        // number of progressive passes (1 if not progressive)
+        int passes() const {
+            return m_pPasses != nullptr ? m_pPasses->m_iPasses : 1;
+        }
+        
+        // number of jobs (lines or tiles) per pass, before tail splitting
+        size_t jobsPerPass() const {
+            return m_uJobsPerPass;
+        }
+        
+        // number of progressive passes completed by all lines
+        int completedPasses() const {
+            return m_pPasses != nullptr ? m_pPasses->completedPasses() : (isFinished() ? 1 : 0);
+        }
+        
+        // estimated noise of the image (progressive rendering, negative until there are two passes)
+        float noiseEstimate() const {
+            return m_pPasses != nullptr ? m_pPasses->m_accumulation.noiseEstimate() : -1.0f;
+        }
+        
+        // progressive rendering: update output image from the samples accumulated so far
+        void resolve() {
+            if (m_pPasses != nullptr) {
+                m_pPasses->m_accumulation.resolve(m_image);
+            }
+        }
+        
         // write current image to file
         void writeToFile(const std::string &_strPath)
         {
+            resolve();
+            
             CORE::Image image;
             image.m_iWidth = m_image.width();
             image.m_iHeight = m_image.height();
@@ -334,24 +744,79 @@ namespace SYSTEMS
         }
         
      private:
-        // split output image into pixel jobs
+        /*
+         Split output image into pixel jobs: lines in shuffled order, or (with a tile size) square tiles in
+         space-filling curve order, which keeps consecutive jobs close on the image (and in the scene).
+         Tiles are split in halves as the queue drains (below one queued job per worker).
+         */
         void createJobs() {
+            std::vector<Tile> tiles;
+            if (m_iTileSize <= 0) {
+                for (int j = 0; j < m_image.height(); j++) {
+                    tiles.push_back(Tile{0, j, m_image.width(), 1});
+                }
+            }
+            else {
+                tiles = createTiles();
+            }
+            
             // create jobs
             std::vector<std::unique_ptr<Job>> jobs;
-            for (int j = 0; j < m_image.height(); j++) {
-                jobs.push_back(std::make_unique<PixelJob>(&m_image, j,
+            for (const auto &tile : tiles) {
+                jobs.push_back(std::make_unique<PixelJob>(&m_image, tile,
                                                           &m_viewport,
                                                           m_pCamera,
                                                           m_pScene,
                                                           &m_frameStats,
                                                           m_iMaxSamplesPerPixel,
-                                                          m_iMaxTraceDepth));
+                                                          m_iMaxTraceDepth,
+                                                          m_iRayPacketSize,
+                                                          m_integrator,
+                                                          m_iMinSamplesPerPixel,
+                                                          m_fAdaptiveThreshold,
+                                                          &m_jobQueue,
+                                                          m_pPasses.get(),
+                                                          m_iTileSize > 0 ? m_iNumWorkers : 0));
             }
             
-            m_frameStats.setJobCount(jobs.size());
+            m_uJobsPerPass = jobs.size();
+            m_frameStats.setJobCount(m_uJobsPerPass * passes());     // (jobs of following passes are pushed by the jobs)
+            
+            if (m_iTileSize <= 0) {
+                // shuffle jobs a little
+                m_jobQueue.push_shuffle(jobs, CORE::generator());
+            }
+            else {
+                m_jobQueue.push(jobs);
+            }
+        }
+        
+        // tiles of the image, in the order of their position on a space-filling curve over the tile grid
+        std::vector<Tile> createTiles() const {
+            const int columns = (m_image.width() + m_iTileSize - 1) / m_iTileSize;
+            const int rows = (m_image.height() + m_iTileSize - 1) / m_iTileSize;
+            const uint32_t order = (uint32_t)CORE::highestBit((uint64_t)std::max(columns, rows) * 2 - 1);     // (grid side 2^order)
+            
+            std::vector<std::pair<uint64_t, Tile>> keys;
+            for (int y = 0; y < rows; y++) {
+                for (int x = 0; x < columns; x++) {
+                    const uint64_t key = m_tileOrder == TILE_ORDER::MORTON ? CORE::mortonCode((uint32_t)x, (uint32_t)y) :
+                                                                             CORE::hilbertIndex(order, (uint32_t)x, (uint32_t)y);
+                    const Tile tile{x * m_iTileSize, y * m_iTileSize,
+                                    std::min(m_iTileSize, m_image.width() - x * m_iTileSize),
+                                    std::min(m_iTileSize, m_image.height() - y * m_iTileSize)};
+                    keys.push_back(std::make_pair(key, tile));
+                }
+            }
+            
+            std::sort(keys.begin(), keys.end(), [](const auto &_a, const auto &_b) {return _a.first < _b.first;});
+            
+            std::vector<Tile> tiles;
+            for (const auto &key : keys) {
+                tiles.push_back(key.second);
+            }
             
-            // shuffle jobs a little
-            m_jobQueue.push_shuffle(jobs, CORE::generator());
+            return tiles;
         }
         
         // create worker threads
@@ -373,7 +838,15 @@ namespace SYSTEMS
         int                                        m_iMaxSamplesPerPixel;
         int                                        m_iNumWorkers;
         int                                        m_iMaxTraceDepth;
+        int                                        m_iRayPacketSize;
+        INTEGRATOR                                 m_integrator;
+        int                                        m_iMinSamplesPerPixel;
+        float                                      m_fAdaptiveThreshold;
+        int                                        m_iTileSize;           // (0 renders lines)
+        TILE_ORDER                                 m_tileOrder;
+        size_t                                     m_uJobsPerPass = 0;
         uint32_t                                   m_uRandomSeed;
+        std::unique_ptr<FramePasses>               m_pPasses;
     };
     
     
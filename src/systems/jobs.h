@@ -3,9 +3,13 @@
 #include "core/constants.h"
 #include "core/memory.h"
 #include "core/queue.h"
+#include "core/random.h"
 
+#include <array>
 #include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <random>
 #include <thread>
 #include <queue>
 #include <vector>
@@ -29,8 +33,223 @@ namespace SYSTEMS
     };
 
 
-    /* collection of jobs for workers */
-    using JobQueue = CORE::Queue<std::unique_ptr<Job>>;
+    /*
+     Collection of jobs for workers (work-stealing scheduler).
+     Submitted jobs go to a shared FIFO queue. Workers take them in chunks into their own deque (Chase-Lev),
+     run jobs from the bottom of it, and steal from the top of the deques of random other workers once their
+     own deque and the shared queue are empty. Jobs spawned by a running job go to the deque of its worker.
+     Workers that find no jobs park until jobs are pushed (no polling).
+     */
+    class JobQueue
+    {
+     public:
+        const static int    MAX_WORKERS     = 256;      // (further workers run without a deque of their own)
+        
+     private:
+        using deque_type = CORE::StealingDeque<Job*>;
+        using victim_rand_type = std::minstd_rand0;     // (apart from the generator used for rendering)
+        
+     public:
+        JobQueue()
+            :m_iWorkers(0),
+             m_uEpoch(0),
+             m_iParked(0)
+        {
+            for (auto &pDeque : m_pDeques) {
+                pDeque = nullptr;
+            }
+        }
+        
+        ~JobQueue() {
+            // delete jobs that were never run
+            Job *pJob = nullptr;
+            for (const auto &pDeque : m_deques) {
+                while (pDeque->steal(pJob) == true) {
+                    delete pJob;
+                }
+            }
+        }
+        
+        /* submit a job (any thread), jobs are taken in submission order */
+        void push(std::unique_ptr<Job> &&_pJob) {
+            m_queue.push(std::move(_pJob));
+            notify(false);
+        }
+        
+        /* submit jobs (any thread) */
+        void push(std::vector<std::unique_ptr<Job>> &_jobs) {
+            m_queue.push(_jobs);
+            notify(true);
+        }
+        
+        /* submit jobs in random order (any thread) */
+        template <typename random_gen>
+        void push_shuffle(std::vector<std::unique_ptr<Job>> &_jobs, random_gen &_gen) {
+            m_queue.push_shuffle(_jobs, _gen);
+            notify(true);
+        }
+        
+        /*
+         Push a job to the deque of the calling worker: it runs next on this worker, unless it is stolen by an
+         idle worker first. Other threads submit the job to the shared queue.
+         */
+        void spawn(std::unique_ptr<Job> &&_pJob) {
+            deque_type *pDeque = localDeque();
+            if (pDeque == nullptr) {
+                push(std::move(_pJob));
+                return;
+            }
+            
+            pDeque->push(_pJob.release());
+            notify(false);
+        }
+        
+        /* number of queued jobs (approximate while workers are running) */
+        size_t size() const {
+            size_t ret = m_queue.size();
+            for (int i = 0; i < m_iWorkers; i++) {
+                ret += m_pDeques[i].load()->size();
+            }
+            
+            return ret;
+        }
+        
+        bool empty() const {
+            return size() == 0;
+        }
+        
+        /* register the calling thread as a worker, returns its index (-1 if it has no deque) */
+        int attach() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            int index = -1;
+            if (m_deques.size() < MAX_WORKERS) {
+                m_deques.push_back(std::make_unique<deque_type>());
+                index = (int)m_deques.size() - 1;
+                m_pDeques[index] = m_deques.back().get();
+                m_iWorkers = index + 1;
+            }
+            
+            localIndex() = std::make_pair(this, index);
+            CORE::seed<victim_rand_type>((uint32_t)index + 2);
+            return index;
+        }
+        
+        /*
+         Next job for the worker (nullptr if there are none): from its own deque, from the shared queue (taking up
+         to _iChunkSize jobs, the others go to its deque) or stolen from another worker.
+         */
+        std::unique_ptr<Job> pop(int _iWorker, int _iChunkSize) {
+            deque_type *pDeque = _iWorker >= 0 ? m_pDeques[_iWorker].load() : nullptr;
+            Job *pJob = nullptr;
+            if ( (pDeque != nullptr) && (pDeque->pop(pJob) == true) ) {
+                return std::unique_ptr<Job>(pJob);
+            }
+            
+            auto jobs = m_queue.pop(pDeque != nullptr ? (size_t)std::max(_iChunkSize, 1) : 1);
+            if (jobs.empty() == false) {
+                // run the last job of the chunk first (the first ones stay on top of the deque, for stealing)
+                for (size_t i = 0; i + 1 < jobs.size(); i++) {
+                    pDeque->push(jobs[i].release());
+                }
+                
+                if (jobs.size() > 1) {
+                    notify(false);      // (parked workers may steal)
+                }
+                
+                return std::move(jobs.back());
+            }
+            
+            return steal(_iWorker);
+        }
+        
+        /* epoch of pushed jobs: read before looking for jobs, and parking returns once it changes */
+        uint64_t epoch() const {
+            return m_uEpoch;
+        }
+        
+        /* park the calling worker until jobs were pushed after _uEpoch, or until _stopped() returns true */
+        template <typename stop_func>
+        void park(uint64_t _uEpoch, const stop_func &_stopped) {
+            m_iParked++;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&]{return (m_uEpoch != _uEpoch) || (_stopped() == true);});
+            m_iParked--;
+        }
+        
+        /* wake all parked workers (e.g. to stop them) */
+        void wakeAll() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cv.notify_all();
+        }
+        
+     private:
+        // steal from the deques of other workers, starting at a random victim
+        std::unique_ptr<Job> steal(int _iWorker) {
+            const int workers = m_iWorkers;
+            if (workers <= 0) {
+                return nullptr;
+            }
+            
+            std::uniform_int_distribution<int> pick(0, workers - 1);
+            const int first = pick(CORE::generator<victim_rand_type>());
+            Job *pJob = nullptr;
+            
+            bool bRetry = true;
+            while (bRetry == true) {
+                bRetry = false;
+                for (int i = 0; i < workers; i++) {
+                    const int victim = (first + i) % workers;
+                    deque_type *pDeque = m_pDeques[victim].load();
+                    if ( (victim == _iWorker) || (pDeque == nullptr) ) {
+                        continue;
+                    }
+                    
+                    if (pDeque->steal(pJob) == true) {
+                        return std::unique_ptr<Job>(pJob);
+                    }
+                    
+                    bRetry |= pDeque->empty() == false;     // (lost the race for the item, try again)
+                }
+            }
+            
+            return nullptr;
+        }
+        
+        // advance the epoch and wake parked workers
+        void notify(bool _bAll) {
+            m_uEpoch++;
+            if (m_iParked > 0) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (_bAll == true) {
+                    m_cv.notify_all();
+                }
+                else {
+                    m_cv.notify_one();
+                }
+            }
+        }
+        
+        // deque of the calling thread, if it is a worker of this queue
+        deque_type *localDeque() const {
+            const auto &local = localIndex();
+            return (local.first == this) && (local.second >= 0) ? m_pDeques[local.second].load() : nullptr;
+        }
+        
+        static std::pair<const JobQueue*, int> &localIndex() {
+            thread_local static std::pair<const JobQueue*, int> tlIndex(nullptr, -1);
+            return tlIndex;
+        }
+        
+     private:
+        CORE::Queue<std::unique_ptr<Job>>                   m_queue;        // (submitted jobs)
+        std::vector<std::unique_ptr<deque_type>>            m_deques;
+        std::array<std::atomic<deque_type*>, MAX_WORKERS>   m_pDeques;
+        std::atomic<int>                                    m_iWorkers;
+        std::atomic<uint64_t>                               m_uEpoch;
+        std::atomic<int>                                    m_iParked;
+        mutable std::mutex                                  m_mutex;
+        std::condition_variable                             m_cv;
+    };
 
 
     /* Worker that can execute jobs */
@@ -57,18 +276,19 @@ namespace SYSTEMS
         
         virtual void stop() {
             m_bRunning = false;
+            m_pJobs->wakeAll();
         }
         
         virtual bool running() const {
             return m_bRunning;
         }
 
-        /* returns true if worker has local jobs */
+        /* returns true if worker is running a job */
         virtual bool busy() const {
             return m_iActiveJobs > 0;
         }
         
-        /* returns the number of local jobs */
+        /* returns the number of running jobs */
         virtual int activeJobs() const {
             return m_iActiveJobs;
         }
@@ -97,20 +317,19 @@ namespace SYSTEMS
         // thread entry point
         void run() {
             onStart();
+            const int index = m_pJobs->attach();
 
             while (m_bRunning == true) {
-                // grab new jobs if local list is empty
-                if (m_localJobs.empty() == true) {
-                    m_localJobs = m_pJobs->pop(m_iJobChunkSize);
-                    m_iActiveJobs = (int)m_localJobs.size();
-                }
-
-                // work on first job in local list
-                if (m_localJobs.empty() == false) {
-                    // find next job
-                    m_iActiveJobs = (int)m_localJobs.size();
-                    m_pCurrentJob = std::move(m_localJobs.back());
-                    m_localJobs.pop_back();
+                // find next job (own deque, shared queue, other workers)
+                const uint64_t epoch = m_pJobs->epoch();
+                auto pJob = m_pJobs->pop(index, m_iJobChunkSize);
+                
+                if (pJob != nullptr) {
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_pCurrentJob = std::move(pJob);
+                        m_iActiveJobs = 1;
+                    }
 
                     // run job
                     m_pCurrentJob->run();
@@ -119,10 +338,11 @@ namespace SYSTEMS
                     std::lock_guard<std::mutex> lock(m_mutex);
                     m_pCurrentJob = nullptr;
                     m_iCompletedJobs++;
-                    m_iActiveJobs--;
+                    m_iActiveJobs = 0;
                 }
                 else {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    // wait for new jobs
+                    m_pJobs->park(epoch, [this]{return m_bRunning == false;});
                 }
             }
             
@@ -132,8 +352,7 @@ namespace SYSTEMS
      private:
         std::thread                                 m_thread;
         JobQueue                                    *m_pJobs;
-        int                                         m_iJobChunkSize;
-        std::vector<std::unique_ptr<Job>>           m_localJobs;
+        int                                         m_iJobChunkSize;        // (jobs taken from the shared queue at once)
         mutable std::mutex                          m_mutex;
         std::unique_ptr<Job>                        m_pCurrentJob;
         std::atomic<int>                            m_iActiveJobs;
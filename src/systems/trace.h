@@ -12,6 +12,8 @@
 #include "base/material.h"
 #include "base/scene.h"
 
+#include <algorithm>
+#include <array>
 #include <vector>
 #include <random>
 #include <atomic>
@@ -27,34 +29,91 @@ namespace SYSTEMS
     class RayTracer
     {
      public:
-        RayTracer(const BASE::Scene *_pScene, uint16_t _uMaxTraceDepth)
+        constexpr static uint32_t MAX_PACKET_SIZE = 32;     // rays per packet
+        
+     public:
+        /*
+         With _bSampleLights, hits are also connected to a point sampled on a scene light (next event estimation).
+         Light samples and the light found by the scattered ray are combined with multiple importance sampling.
+         */
+        RayTracer(const BASE::Scene *_pScene, uint16_t _uMaxTraceDepth, bool _bSampleLights = false)
             :m_pScene(_pScene),
              m_uTraceLimit(_uMaxTraceDepth),
+             m_bSampleLights(_bSampleLights),
              m_uRayCount(0)
         {}
         
         template <typename R>
         CORE::Color trace(R &&_ray) {
+            if (m_uTraceLimit == 0) {
+                return CORE::Color(0, 0, 0);
+            }
+            
+            m_uRayCount++;
+            BASE::Intersect hit(std::forward<R>(_ray));
+            const bool bHit = m_pScene->hit(hit);
+            return tracePath(hit, bHit);
+        }
+        
+        /*
+         Traces a packet of (coherent) primary rays: the first hits of all rays share one scene traversal,
+         later bounces are traced one ray at a time.
+         */
+        void tracePacket(const CORE::Ray *_pRays, CORE::Color *_pColors, uint32_t _uCount) {
+            std::array<BASE::Intersect, MAX_PACKET_SIZE> hits;
+            _uCount = std::min(_uCount, MAX_PACKET_SIZE);
+            
+            for (uint32_t i = 0; i < _uCount; i++) {
+                hits[i] = BASE::Intersect(_pRays[i]);
+                _pColors[i] = CORE::Color(0, 0, 0);
+            }
+            
+            if (m_uTraceLimit == 0) {
+                return;
+            }
+            
+            m_uRayCount += _uCount;
+            const uint32_t mask = m_pScene->hitPacket(hits.data(), _uCount);
+            for (uint32_t i = 0; i < _uCount; i++) {
+                _pColors[i] = tracePath(hits[i], (mask & (1u << i)) != 0);
+            }
+        }
+        
+        uint64_t rayCount() const {return m_uRayCount;}
+
+     private:
+        // shade path from its first hit (already checked), tracing the following bounces
+        CORE::Color tracePath(BASE::Intersect &_hit, bool _bHit) {
             const uint16_t bounceMin = 3;
             CORE::Color tracedColor(0, 0, 0);
             CORE::Color attColor(1, 1, 1);
-            CORE::Ray ray(std::forward<R>(_ray));
             std::uniform_real_distribution<float> uniform01(0, 1.0f);
+            float bsdfPdf = 0;             // pdf of the scattered ray that found the hit (0 if lights were not sampled)
+            CORE::Vec bsdfOrigin;
             
-            for (uint16_t i = 0; i < m_uTraceLimit; i++) {
-                m_uRayCount++;
-                BASE::Intersect hit(ray);
-
-                // check for hits on scene
-                if (m_pScene->hit(hit) == true) {
+            for (uint16_t i = 0; ; ) {
+                if (_bHit == true) {
                     // complete hit
-                    hit.m_pPrimitive->intersect(hit);
-                    hit.m_uTraceDepth = i + 1;
+                    _hit.m_pPrimitive->intersect(_hit);
+                    _hit.m_uTraceDepth = i + 1;
                     
                     // calculate hit on material
+                    const BASE::Material *pMaterial = _hit.m_pPrimitive->material();
                     auto scatteredRay = CORE::ScatteredRay();
-                    hit.m_pPrimitive->material()->scatter(scatteredRay, hit);
-                    tracedColor += attColor * scatteredRay.m_emitted;
+                    pMaterial->scatter(scatteredRay, _hit);
+                    if ( (bsdfPdf > 0) && (scatteredRay.m_emitted.isBlack() == false) ) {
+                        tracedColor += attColor * scatteredRay.m_emitted * lightHitWeight(_hit, bsdfOrigin, bsdfPdf);
+                    }
+                    else {
+                        tracedColor += attColor * scatteredRay.m_emitted;
+                    }
+                    
+                    // connect hit to lights
+                    if (m_bSampleLights == true) {
+                        tracedColor += attColor * sampleLight(_hit, pMaterial);
+                        bsdfPdf = pMaterial->pdf(_hit, scatteredRay.m_ray.m_direction.normalized());
+                    }
+                    
                     attColor *= scatteredRay.m_color;
                     
                     // stop on long paths
@@ -68,7 +127,17 @@ namespace SYSTEMS
                     }
 
                     // transform ray back to world space
-                    ray = hit.m_pPrimitive->transformRayFrom(scatteredRay.m_ray);
+                    auto ray = _hit.m_pPrimitive->transformRayFrom(scatteredRay.m_ray);
+                    bsdfOrigin = ray.m_origin;
+                    
+                    if (++i >= m_uTraceLimit) {
+                        break;
+                    }
+                    
+                    // check for hits on scene
+                    m_uRayCount++;
+                    _hit = BASE::Intersect(ray);
+                    _bHit = m_pScene->hit(_hit);
                 }
                 else {
                     tracedColor += attColor * m_pScene->backgroundColor();
@@ -79,11 +148,74 @@ namespace SYSTEMS
             return tracedColor;
         }
         
-        uint64_t rayCount() const {return m_uRayCount;}
-
+        // light reflected at a (completed) hit from a point sampled on a light, if that point is not in shadow (MIS weighted)
+        CORE::Color sampleLight(const BASE::Intersect &_hit, const BASE::Material *_pMaterial) {
+            const CORE::Axis &axis = _hit.m_pPrimitive->axis();
+            const CORE::Vec position = axis.transformFrom(_hit.m_position);
+            
+            BASE::LightSample light;
+            if ( (m_pScene->sampleLight(light, position) == false) || (light.m_fPdf <= 0) || (light.m_emitted.isBlack() == true) ) {
+                return CORE::Color(0, 0, 0);
+            }
+            
+            const CORE::Vec toLight = light.m_position - position;
+            const float distSqr = toLight.sizeSqr();
+            const float dist = sqrt(distSqr);
+            const CORE::Vec direction = toLight / dist;
+            const float cosLight = -(direction * light.m_normal);
+            if (cosLight <= 0) {
+                return CORE::Color(0, 0, 0);
+            }
+            
+            // scattering towards the light (in primitive space)
+            const CORE::Vec localDirection = axis.rotateTo(direction).normalized();
+            CORE::Color scattered = _pMaterial->eval(_hit, localDirection);
+            if (scattered.isBlack() == true) {
+                return CORE::Color(0, 0, 0);
+            }
+            
+            // shadow ray (stops just short of the light)
+            m_uRayCount++;
+            if (m_pScene->occluded(CORE::Ray(position, direction), dist * (1 - 1e-3f)) == true) {
+                return CORE::Color(0, 0, 0);
+            }
+            
+            // light pdf per solid angle
+            const float lightPdf = light.m_fPdf * distSqr / cosLight;
+            return scattered * light.m_emitted * (powerHeuristic(lightPdf, _pMaterial->pdf(_hit, localDirection)) / lightPdf);
+        }
+        
+        // MIS weight of light emitted at a (completed) hit found by a scattered ray (from _origin, sampled with _fBsdfPdf)
+        float lightHitWeight(const BASE::Intersect &_hit, const CORE::Vec &_origin, float _fBsdfPdf) const {
+            const CORE::Axis &axis = _hit.m_pPrimitive->axis();
+            const CORE::Vec position = axis.transformFrom(_hit.m_position);
+            
+            const float areaPdf = m_pScene->lightPdf(_hit.m_pPrimitive, _origin, position);
+            if (areaPdf <= 0) {
+                return 1.0f;    // light is not sampled
+            }
+            
+            const CORE::Vec toLight = position - _origin;
+            const float distSqr = toLight.sizeSqr();
+            const float cosLight = fabs(axis.rotateFrom(_hit.m_normal).normalized() * toLight) / sqrt(distSqr);
+            if (cosLight <= 0) {
+                return 1.0f;
+            }
+            
+            return powerHeuristic(_fBsdfPdf, areaPdf * distSqr / cosLight);
+        }
+        
+        // power heuristic (beta = 2) for the sample with pdf _fPdf
+        static float powerHeuristic(float _fPdf, float _fOtherPdf) {
+            const float a = _fPdf * _fPdf;
+            const float b = _fOtherPdf * _fOtherPdf;
+            return a + b > 0 ? a / (a + b) : 0.0f;
+        }
+        
      private:
         const BASE::Scene   *m_pScene;
         uint16_t            m_uTraceLimit;
+        bool                m_bSampleLights;
         uint64_t            m_uRayCount;
     };
 
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "core/color.h"
+#include "core/constants.h"
+#include "core/morton.h"
+#include "core/random.h"
+#include "core/ray.h"
+#include "core/scattered_ray.h"
+#include "base/intersect.h"
+#include "base/material.h"
+#include "base/primitive.h"
+#include "base/scene.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace SYSTEMS
+{
+    /*
+     Wavefront (streaming) path tracer.
+     Keeps a pool of paths in SoA buffers and advances all of them one bounce at a time, in stages:
+        - generate: paths from camera rays (one per pixel sample)
+        - sort rays (optional, secondary rays only): paths ordered by ray direction octant and Morton code of
+                    the ray origin, so that consecutive hit checks visit similar parts of the scene
+        - extend:   closest hits of all active paths (in packets of neighbouring paths, if enabled)
+        - sort:     hits sorted by material, so that shading runs through one material at a time
+        - shade:    complete hits, scatter, accumulate emitted light, russian roulette
+        - compact:  move the paths that are still active to the front of the buffers
+     Paths follow the same bounce and russian roulette rules as RayTracer::trace, only the order of work differs.
+     Runs on the calling (worker) thread; buffers are reused between calls.
+     */
+    class WavefrontTracer
+    {
+     public:
+        WavefrontTracer(const BASE::Scene *_pScene, uint16_t _uMaxTraceDepth, uint32_t _uRayPacketSize, bool _bSortRays)
+            :m_pScene(_pScene),
+             m_uTraceLimit(_uMaxTraceDepth),
+             m_uRayPacketSize(std::max(_uRayPacketSize, 1u)),
+             m_bSortRays(_bSortRays),
+             m_uRayCount(0)
+        {}
+
+        /*
+         Traces paths for the given camera rays and adds their radiance to _pColors[_pixels[i]].
+         */
+        void trace(const std::vector<CORE::Ray> &_rays, const std::vector<uint32_t> &_pixels, CORE::Color *_pColors) {
+            generate(_rays, _pixels);
+
+            for (int bounce = 0; m_uActive > 0; bounce++) {
+                if ( (m_bSortRays == true) && (bounce > 0) ) {
+                    sortRays();     // (camera rays are coherent already)
+                }
+                
+                extend();
+                sort();
+                shade(_pColors);
+                compact();
+            }
+        }
+
+        uint64_t rayCount() const {return m_uRayCount;}
+
+     private:
+        // stage: new paths from camera rays
+        void generate(const std::vector<CORE::Ray> &_rays, const std::vector<uint32_t> &_pixels) {
+            const size_t count = std::min(_rays.size(), _pixels.size());
+            m_rays.assign(_rays.begin(), _rays.begin() + count);
+            m_pixels.assign(_pixels.begin(), _pixels.begin() + count);
+            m_throughput.assign(count, CORE::Color(1, 1, 1));
+            m_depth.assign(count, 0);
+            m_active.assign(count, 1);
+            m_hits.resize(count);
+            m_uActive = m_uTraceLimit > 0 ? count : 0;
+        }
+
+        // stage: order active paths by ray direction octant and origin (Morton code within the bounds of all origins)
+        void sortRays() {
+            CORE::Bounds bounds(m_rays[0].m_origin, m_rays[0].m_origin);
+            for (size_t i = 1; i < m_uActive; i++) {
+                bounds.m_min = perElementMin(bounds.m_min, m_rays[i].m_origin);
+                bounds.m_max = perElementMax(bounds.m_max, m_rays[i].m_origin);
+            }
+
+            m_keys.resize(m_uActive);
+            for (size_t i = 0; i < m_uActive; i++) {
+                const auto &ray = m_rays[i];
+                const uint64_t octant = (uint64_t)(ray.m_direction.x() < 0) |
+                                        ((uint64_t)(ray.m_direction.y() < 0) << 1) |
+                                        ((uint64_t)(ray.m_direction.z() < 0) << 2);
+                m_keys[i] = std::make_pair((octant << 30) | (CORE::mortonCode(ray.m_origin, bounds) >> 33), (uint32_t)i);  // 33-bit key (10 bits per axis)
+            }
+
+            CORE::radixSort(m_keys);
+
+            // gather path state in sorted order
+            auto gather = [&](auto &_items) {
+                std::decay_t<decltype(_items)> sorted(m_uActive);
+                for (size_t i = 0; i < m_uActive; i++) {
+                    sorted[i] = _items[m_keys[i].second];
+                }
+                
+                std::copy(sorted.begin(), sorted.end(), _items.begin());
+            };
+
+            gather(m_rays);
+            gather(m_pixels);
+            gather(m_throughput);
+            gather(m_depth);
+        }
+
+        // stage: closest hits of active paths
+        void extend() {
+            for (size_t i = 0; i < m_uActive; i++) {
+                m_hits[i] = BASE::Intersect(m_rays[i]);
+            }
+
+            m_uRayCount += m_uActive;
+            m_hitMask.assign((m_uActive + 31) / 32, 0);
+
+            if (m_uRayPacketSize > 1) {
+                for (size_t first = 0; first < m_uActive; first += m_uRayPacketSize) {
+                    const uint32_t count = (uint32_t)std::min<size_t>(m_uRayPacketSize, m_uActive - first);
+                    const uint32_t mask = m_pScene->hitPacket(&m_hits[first], count);
+                    for (uint32_t i = 0; i < count; i++) {
+                        setHit(first + i, (mask & (1u << i)) != 0);
+                    }
+                }
+            }
+            else {
+                for (size_t i = 0; i < m_uActive; i++) {
+                    setHit(i, m_pScene->hit(m_hits[i]));
+                }
+            }
+        }
+
+        /*
+         stage: order of shading (misses first, then hits grouped by material)
+         Materials are ranked in order of their first hit (not by address), so that the shading order (and with it
+         the random number sequence) is the same on every run.
+         */
+        void sort() {
+            m_order.resize(m_uActive);
+            m_materialRanks.clear();
+            
+            const BASE::Material *pLastMaterial = nullptr;
+            uint32_t lastRank = 0;
+            for (size_t i = 0; i < m_uActive; i++) {
+                const BASE::Material *pMaterial = isHit(i) ? m_hits[i].m_pPrimitive->material() : nullptr;
+                uint32_t rank = 0;     // (miss)
+                if (pMaterial != nullptr) {
+                    if (pMaterial != pLastMaterial) {
+                        pLastMaterial = pMaterial;
+                        lastRank = m_materialRanks.emplace(pMaterial, (uint32_t)m_materialRanks.size() + 1).first->second;
+                    }
+                    
+                    rank = lastRank;
+                }
+                
+                m_order[i] = std::make_pair(rank, (uint32_t)i);
+            }
+
+            std::sort(m_order.begin(), m_order.end());
+        }
+
+        // stage: shade hits and scatter (or terminate) paths
+        void shade(CORE::Color *_pColors) {
+            const uint16_t bounceMin = 3;
+            std::uniform_real_distribution<float> uniform01(0, 1.0f);
+
+            for (const auto &item : m_order) {
+                const uint32_t i = item.second;
+                auto &color = _pColors[m_pixels[i]];
+                auto &throughput = m_throughput[i];
+
+                if (item.first == 0) {
+                    color += throughput * m_pScene->backgroundColor();
+                    m_active[i] = 0;    // stop -- no hits
+                    continue;
+                }
+
+                // complete hit
+                auto &hit = m_hits[i];
+                const BASE::Material *pMaterial = hit.m_pPrimitive->material();
+                hit.m_pPrimitive->intersect(hit);
+                hit.m_uTraceDepth = m_depth[i] + 1;
+
+                // calculate hit on material
+                auto scatteredRay = CORE::ScatteredRay();
+                pMaterial->scatter(scatteredRay, hit);
+                color += throughput * scatteredRay.m_emitted;
+                throughput *= scatteredRay.m_color;
+
+                // stop on long paths
+                if (m_depth[i] > bounceMin) {
+                    float p = throughput.max();
+                    if (p < uniform01(CORE::generator())) {
+                        m_active[i] = 0;    // stop -- attenuation very low
+                        continue;
+                    }
+
+                    throughput *= 1.0f/p;
+                }
+
+                // transform ray back to world space
+                m_rays[i] = hit.m_pPrimitive->transformRayFrom(scatteredRay.m_ray);
+                if (++m_depth[i] >= m_uTraceLimit) {
+                    m_active[i] = 0;
+                }
+            }
+        }
+
+        // stage: move active paths to the front (keeping their order)
+        void compact() {
+            size_t count = 0;
+            for (size_t i = 0; i < m_uActive; i++) {
+                if (m_active[i] != 0) {
+                    if (count != i) {
+                        m_rays[count] = m_rays[i];
+                        m_pixels[count] = m_pixels[i];
+                        m_throughput[count] = m_throughput[i];
+                        m_depth[count] = m_depth[i];
+                        m_active[count] = 1;
+                    }
+
+                    count++;
+                }
+            }
+
+            m_uActive = count;
+        }
+
+        void setHit(size_t _uIndex, bool _bHit) {
+            m_hitMask[_uIndex / 32] |= (uint32_t)_bHit << (_uIndex % 32);
+        }
+
+        bool isHit(size_t _uIndex) const {
+            return (m_hitMask[_uIndex / 32] & (1u << (_uIndex % 32))) != 0;
+        }
+
+     private:
+        const BASE::Scene                                   *m_pScene;
+        uint16_t                                            m_uTraceLimit;
+        uint32_t                                            m_uRayPacketSize;
+        bool                                                m_bSortRays;
+        uint64_t                                            m_uRayCount;
+
+        // path state (SoA, active paths in [0, m_uActive))
+        size_t                                              m_uActive = 0;
+        std::vector<CORE::Ray>                              m_rays;
+        std::vector<uint32_t>                               m_pixels;
+        std::vector<CORE::Color>                            m_throughput;
+        std::vector<uint16_t>                               m_depth;
+        std::vector<uint8_t>                                m_active;
+
+        // stage buffers
+        std::vector<BASE::Intersect>                        m_hits;
+        std::vector<uint32_t>                               m_hitMask;
+        std::vector<std::pair<uint32_t, uint32_t>>          m_order;            // (material rank, path)
+        std::unordered_map<const BASE::Material*, uint32_t> m_materialRanks;
+        std::vector<std::pair<uint64_t, uint32_t>>          m_keys;
+    };
+
+};  // namespace SYSTEMS